@@ -16,30 +16,27 @@
 // #########################
 
 // ############################ Protected Methods #############################
-
-// Create new list item and place programmer's data within it,
-// make new links with previous item if wished.
-// returns a pointer to the new item, NULL if operation failed.
-//
-// Parameters:
-//     pItem    : Pointer to the object to be stored.
-//     LinkItem : Pointer to end of list where item to be added.
+// Enlarge the array of items, keeping their order.
 //
 // Return Values:
-//     LinkItem : returns pointer to newly added item in list,
-//                NULL if operation failed. However items within list
-//                before hand still exist.
-LinkItem* QueueList::newItem (ANYOBJECT* pItem, LinkItem* pEndList)
+//     int      : 0 if successful, -1 if memory allocation failed.
+//                However items within list before hand still exist.
+int QueueList::grow (void)
 {
-    LinkItem*  pNewStruct = new LinkItem;
+    int        newLimit = (itemLimit != 0) ? (itemLimit * 2) : 16;
+    ANYOBJECT** pNewItems = new ANYOBJECT*[newLimit];
 
-    if (pNewStruct != NULL)
-    {
-        pNewStruct->pLinkedItem    = pEndList;
-        pNewStruct->pStoredItem    = pItem;
-    }
+    if (pNewItems == NULL)
+        return -1;
+
+    for (int n = 0; n < itemCount; n++)
+        pNewItems[n] = pItems[(firstPos + n) % itemLimit];
 
-    return pNewStruct;
+    delete[] pItems;
+    pItems    = pNewItems;
+    itemLimit = newLimit;
+    firstPos  = 0;
+    return 0;
 }
 
 
@@ -47,7 +44,9 @@ LinkItem* QueueList::newItem (ANYOBJECT* pItem, LinkItem* pEndList)
 // ############################### Constructors ###############################
 #define MY_DEFAULT \
    itemCount(0), \
-   pEndPos(NULL), \
+   pItems(NULL), \
+   itemLimit(0), \
+   firstPos(0), \
    spaceAvailable(0)
 
 QueueList::QueueList (void)
@@ -83,15 +82,14 @@ QueueList::QueueList (ANYOBJECT* pItem)
 //
 int QueueList::putLast (ANYOBJECT* pItem)
 {
-    LinkItem*   pNewItem = newItem (pItem, pEndPos);
-    if (pNewItem != NULL)
+    if (itemCount == itemLimit && grow () != 0)
     {
-        pEndPos = pNewItem;
-        itemCount++;
-        return 0;
+        spaceAvailable = -1;
+        return -1;          // could not add item to list!
     }
-    spaceAvailable = -1;
-    return -1;          // could not add item to list!
+    pItems[(firstPos + itemCount) % itemLimit] = pItem;
+    itemCount++;
+    return 0;
 }
 
 
@@ -104,29 +102,10 @@ int QueueList::putLast (ANYOBJECT* pItem)
 //
 ANYOBJECT* QueueList::takeNext (void)
 {
-    if (pEndPos != NULL)
+    if (itemCount > 0)
     {
-        LinkItem* pUpDateList = pEndPos;
-        LinkItem* pStartPos   = pEndPos;
-
-        // move down list until start has been reached
-        while (pStartPos->pLinkedItem != NULL)
-            pStartPos = pStartPos->pLinkedItem;
-
-        if (pStartPos != pUpDateList) // if not the last item in list
-        {
-            // retrieve data and delete item from list
-            while (pUpDateList->pLinkedItem != pStartPos)
-            pUpDateList = pUpDateList->pLinkedItem;
-        }
-        else
-        {
-            pEndPos = NULL;     // start new list after all items gone
-        }
-
-        ANYOBJECT* pTemp = pStartPos->pStoredItem;  // copy value to user
-        pUpDateList->pLinkedItem = NULL;            // make new start of list
-        delete pStartPos;                           // delete object
+        ANYOBJECT* pTemp = pItems[firstPos];        // copy value to user
+        firstPos = (firstPos + 1) % itemLimit;      // make new start of list
         itemCount--;                                // one less
         if (spaceAvailable)                         // if no memory available before...
             spaceAvailable = 0; // there is now!
@@ -173,47 +152,20 @@ int QueueList::space (void)     // return Queue space left
 //
 ANYOBJECT*   QueueList::peek (int numFromNext)
 {
-    if (pEndPos != NULL)
-    {
-        //if (numFromNext > itemCount) //error checking !
-        //   return NULL;
-
-        int count = itemCount - numFromNext;
-        LinkItem* pStartPos   = pEndPos;
-
-        if (count >= 0)
-        {
-            // move down list until start has been reached
-            while (count > 0)
-            {
-                  pStartPos = pStartPos->pLinkedItem;
-                  count--;
-            }
-
-            if (pStartPos != NULL)
-                return pStartPos->pStoredItem;
-        }
-    }
+    if (numFromNext >= 1 && numFromNext <= itemCount)
+        return pItems[(firstPos + numFromNext - 1) % itemLimit];
     return NULL;
 }
 
-
-
 // ############################### Destructor ###############################
 // Method will remove all list items from memory if they still exist,
 // no garbage collection provided, or used.
 //
 QueueList::~QueueList (void)
 {
-    LinkItem* pTemp = pEndPos;
-
-    while (pEndPos != NULL)
-    {
-        pEndPos = pEndPos->pLinkedItem;   // advance to next item
-        delete    pTemp  ->pStoredItem;   // kill data contained
-        delete    pTemp;                  // kill item
-        pTemp   = pEndPos;
-    }
+    while (itemCount > 0)
+        delete takeNext ();               // kill data contained
+    delete[] pItems;
 }
 
 #endif
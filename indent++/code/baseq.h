@@ -4,37 +4,27 @@
 
 // Code written by Steven De Toni ACBC 11
 // this header definition contains a container class that stores data
-// in a queued linked list.
+// in a queue.  The items are held in a circular array, which grows as needed,
+// so that adding an item does not (usually) allocate memory.
 
 #include "anyobj.h" // include base class
 
-struct LinkItem
-{
-      LinkItem*   pLinkedItem; // linker (pointer to the next item in the list)
-      ANYOBJECT*  pStoredItem; // data that is store within a list item
-};
-
 class QueueList
 {
     protected:
         int           itemCount;
-        LinkItem*     pEndPos;
+        ANYOBJECT**   pItems;         // circular array of stored items
+        int           itemLimit;      // size of pItems
+        int           firstPos;       // index in pItems of the next item
         int           spaceAvailable; // set to 0 for space available,
                                             // -1 if no space available;
 
-        // Create new list item and place programmer's data within it,
-        // make new links with previous item if wished.
-        // returns a pointer to the new item, NULL if operation failed.
-        //
-        // Parameters:
-        //     pItem    : Pointer to the object to be stored.
-        //     LinkItem : Pointer to end of list where item to be added.
+        // Enlarge the array of items, keeping their order.
         //
         // Return Values:
-        //     LinkItem : returns pointer to newly added item in list,
-        //                NULL if operation failed. However items within list
-        //                before hand still exist.
-        LinkItem* newItem (ANYOBJECT* pItem, LinkItem* pEndList);
+        //     int      : 0 if successful, -1 if memory allocation failed.
+        //                However items within list before hand still exist.
+        int grow (void);
 
     public:
         // constructors
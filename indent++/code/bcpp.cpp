@@ -166,7 +166,7 @@
 #include "cmdline.h"           // ProcessCommandLine()
 #include "bcpp.h"
 
-#if defined(MORGAN) && (MORGAN == 1) 
+#if defined(MORGAN) && (MORGAN == 1) && !defined(BCPP_NO_MAIN)
 #include <copyfile.h>
 #endif
 
@@ -451,26 +451,32 @@ static bool isContinuation(OutputStruct *pItem)
     return isContinuation(len, pItem->pCode, pItem->pCFlag);
 }
 
+// Given the index of the backslash which continues a line, trim the blanks
+// before it to one, returning the backslash's new index.
+static size_t TrimContinuation(char *pData, char *pState, size_t len)
+{
+    while (len > 1
+     && isspace(pState[len-1])
+     && isspace(pState[len-2]))
+    {
+        len--;
+        pData[len-1] = SPACE;
+        pData[len]  = ESCAPE; pData[len+1]  = NULLC;
+        pState[len] = Normal; pState[len+1] = NullC;
+    }
+    if (len > 0
+     && isspace(pState[len-1]))
+    {
+        pData[len-1] = SPACE;
+    }
+    return len;
+}
+
 static void TrimContinuation(char *pData, char *pState)
 {
     size_t len;
     if (isContinuation(len, pData, pState))
-    {
-        while (len > 1
-         && isspace(pState[len-1])
-         && isspace(pState[len-2]))
-        {
-            len--;
-            pData[len-1] = SPACE;
-            pData[len]  = ESCAPE; pData[len+1]  = NULLC;
-            pState[len] = Normal; pState[len+1] = NullC;
-        }
-        if (len > 0
-         && isspace(pState[len-1]))
-        {
-            pData[len-1] = SPACE;
-        }
-    }
+        TrimContinuation(pData, pState, len);
 }
 
 // check if the given data is a preprocessor-line
@@ -498,6 +504,109 @@ static inline bool BeginsCurly(OutputStruct* pOut)
     return result;
 }
 
+// ----------------------------------------------------------------------------
+// DecodeLine() splits fragments from the front of a line, recursing on what
+// is left.  It advances past each fragment rather than shifting the rest of
+// the line down, and remembers the end of the line and where the braces and
+// comments it searched for were found, so that splitting a long line into
+// many fragments does not rescan the rest of it for each one.
+//
+enum ScanKind { scanLCurl = 0, scanRCurl, scanComment, scanIgnore, scanKinds };
+
+struct LineScan
+{
+    char* pEnd;                 // terminating null of the line, if known
+    char* pFrom[scanKinds];     // where each search last began, if known
+    char* pFound[scanKinds];    // ...and what it found, or pEnd
+
+    LineScan(void) : pEnd(0), pFrom(), pFound() { }
+
+    // the line has been changed other than by trimming its ends
+    void forget(void)
+    {
+        pEnd = 0;
+        for (int n = 0; n < scanKinds; ++n)
+            pFrom[n] = 0;
+    }
+};
+
+static char* LineEnd(LineScan& scan, char* pLineData)
+{
+    if (scan.pEnd == 0)
+        scan.pEnd = pLineData + strlen(pLineData);
+    return scan.pEnd;
+}
+
+// Returns the index of the first brace in normal code (scanLCurl, scanRCurl),
+// or of the first character of a comment (scanComment, scanIgnore), at or
+// after start, or -1 if there is none.
+static int FindInLine(LineScan& scan, ScanKind kind, char* pLineData, char* pLineState, int start = 0)
+{
+    char* pEnd  = LineEnd(scan, pLineData);
+    char* pFrom = pLineData + start;
+    char* p     = scan.pFound[kind];
+
+    if (pFrom > pEnd)
+        return -1;
+
+    if (scan.pFrom[kind] == 0
+     || pFrom < scan.pFrom[kind]
+     || pFrom > p)
+    {
+        for (p = pFrom; p < pEnd; ++p)
+        {
+            char state = pLineState[p - pLineData];
+            if (kind == scanLCurl || kind == scanRCurl)
+            {
+                if (state == Normal
+                 && *p == ((kind == scanLCurl) ? L_CURL : R_CURL))
+                    break;
+            }
+            else if (state == ((kind == scanComment) ? Comment : Ignore))
+                break;
+        }
+        scan.pFrom[kind]  = pFrom;
+        scan.pFound[kind] = p;
+    }
+    return (p < pEnd) ? static_cast<int>(p - pLineData) : -1;
+}
+
+// Like StripSpacingLeftRight(), but advances past the leading blanks.
+static int StripLineSpacing (LineScan& scan, char* &pLineData, char* &pLineState)
+{
+    char* pEnd = LineEnd(scan, pLineData);
+    int result = 0;
+
+    while (pLineData < pEnd && *pLineState == Blank)
+    {
+        ++pLineData;
+        ++pLineState;
+        ++result;
+    }
+
+    size_t len = pEnd - pLineData;
+    if (len != 0 && pLineState[len - 1] == Blank)
+    {
+        while (len != 0 && pLineState[len - 1] == Blank)
+            --len;
+        TerminateLine(pLineData, pLineState, len);
+        scan.pEnd = pLineData + len;
+    }
+    return result;
+}
+
+// Like isContinuation(), for the line being split.
+static bool LineContinues(LineScan& scan, size_t &len, char *pLineData, char *pLineState)
+{
+    len = LineEnd(scan, pLineData) - pLineData;
+    if (len != 0
+     && pLineData[--len] == ESCAPE
+     && pLineState[len] != Comment
+     && pLineState[len] != Ignore)
+        return true;
+    return false;
+}
+
 // ----------------------------------------------------------------------------
 // This function is used within function DecodeLine(), it creates a new
 // InputStructure and stores what is contained in pLineData string in
@@ -524,27 +633,23 @@ static InputStruct* ExtractCode (int      offset,
     char* pNewState = 0;
     InputStruct* pItem = 0;
 
-    if ((pNewCode = NewString(pLineData)) != 0)
+    if ((pNewCode = NewFragment(pLineData, pLineState, pNewState)) != 0)
     {
-        if ((pNewState =  NewString(pLineState)) != 0)
+        // strip spacing in new string before storing
+        if (removeSpace != False)
         {
-            // strip spacing in new string before storing
-            if (removeSpace != False)
-            {
-                offset += StripSpacingLeftRight (pNewCode, pNewState);
-                if (dataType == Code
-                 || dataType == PreP)
-                    TrimContinuation(pNewCode, pNewState);
-            }
-            if ((pItem = new InputStruct(dataType, offset)) != 0)
-            {
-                pItem -> pData    = pNewCode;
-                pItem -> pState   = pNewState;
-                return pItem;
-            }
-            delete pNewState;
+            offset += StripSpacingLeftRight (pNewCode, pNewState);
+            if (dataType == Code
+             || dataType == PreP)
+                TrimContinuation(pNewCode, pNewState);
         }
-        delete pNewCode;
+        if ((pItem = new InputStruct(dataType, offset)) != 0)
+        {
+            pItem -> pData    = pNewCode;
+            pItem -> pState   = pNewState;
+            return pItem;
+        }
+        delete[] pNewCode;
     }
 
     return 0;
@@ -618,8 +723,7 @@ static inline void CleanInputStruct (InputStruct* pDelStruct)
 {
     if (pDelStruct != NULL)
     {
-        delete[] pDelStruct -> pState;
-        delete[] pDelStruct -> pData;
+        delete[] pDelStruct -> pData;   // and pState
         delete pDelStruct;
     }
 }
@@ -643,21 +747,6 @@ static int DecodeLineCleanUp (QueueList* pDelQueue)
     return -1;
 }
 
-static int FindStartofComment(char *pLineState, CharState code = Comment)
-{
-    int it = -1;
-    int n;
-    for (n = 0; pLineState[n] != NullC; n++)
-    {
-        if (pLineState[n] == code)
-        {
-            it = n;
-            break;
-        }
-    }
-    return it;
-}
-
 static int FindEndofComment(char *pLineState)
 {
     int it = -1;
@@ -674,23 +763,6 @@ static int FindEndofComment(char *pLineState)
     return it;
 }
 
-// find punctuation delimiting code, e.g., curly braces or semicolon
-static int FindPunctuation(char *pLineData, char *pLineState, char punct)
-{
-    int it = -1;
-    int n;
-    for (n = 0; pLineData[n] != NULLC; n++)
-    {
-        if (pLineState[n] == Normal
-         && pLineData[n] == punct)
-        {
-            it = n;
-            break;
-        }
-    }
-    return it;
-}
-
 // ----------------------------------------------------------------------------
 // When splitting a line (e.g., to move an open brace), check to see if the
 // right fragment has a backslash escaping the newline.  If so, append one to
@@ -700,54 +772,43 @@ static int FindPunctuation(char *pLineData, char *pLineState, char punct)
 // pLineData  : Pointer to a line of a users input file (string).
 // pLineState : Pointer to a state of a users input line (string).
 //
-static void splitContinuation(InputStruct *pItem, char *pLineData, char *pLineState, bool force)
+static void splitContinuation(InputStruct *pItem, char *pLineData, char *pLineState, LineScan& scan, bool force)
 {
     size_t len = 0;
 
     if (force && !strcmp(pLineData, pItem->pData))
         force = False;
 
-    if ((force || isContinuation(len, pLineData, pLineState))
+    if ((force || LineContinues(scan, len, pLineData, pLineState))
      && !isContinuation(len, pItem->pData, pItem->pState))
     {
-        char *s = new char[len + 4];
+        char *s = new char[2 * (len + 4)];
+        char *t = s + len + 4;
         strcpy(s, pItem->pData);
         strcat(s, " \\");
+
+        strcpy(t, pItem->pState);
+        t[++len] = Blank;
+        t[++len] = Normal;
+        t[++len] = NullC;
         delete[] pItem->pData;
         pItem->pData = s;
-
-        s = new char[len + 4];
-        strcpy(s, pItem->pState);
-        s[++len] = Blank;
-        s[++len] = Normal;
-        s[++len] = NullC;
-        delete[] pItem->pState;
-        pItem->pState = s;
+        pItem->pState = t;
     }
 }
 
 // ----------------------------------------------------------------------------
-// This function is a single pass decoder for a line of input code that
-// is read from the user's input file. The function stores each part of a line,
-// be it a comment (with its attributes), code, open brace, close brace, or
-// blank line as a InputStructure, each InputStructure is stored within
-// a Queue Object.
-//
-// Parameters:
-// offset     : offset within original line's text of this component
-// pLineData  : Pointer to a line of a users input file (string).
-// pLineState : Pointer to a state of a users input line (string).
-// QueueList* : Pointer to a QueueList object will contains all of
-//              a lines basic elements. If this object doesn't contain
-//              any elements, then it suggests there was a processing
-//              problem.
+// DecodeLine() calls this to take the next fragments from the front of the
+// line, advancing offset, pLineData and pLineState past them.
 //
 // Return Values:
-// int        : returns a error code.
-//              -1 : Memory allocation failure
-//               0 : No Worries
+// int        : -1 : Memory allocation failure
+//               0 : The whole line is decoded
+//               1 : Decode the rest of the line
 //
-static int DecodeLine (bool afterSlash, int offset, char* pLineData, char *pLineState, QueueList* pInputQueue)
+static int DecodeLine (bool afterSlash, int offset, char* pLineData, char *pLineState, QueueList* pInputQueue, LineScan& scan);
+
+static int DecodeFragments (bool afterSlash, int& offset, char* &pLineData, char* &pLineState, QueueList* pInputQueue, LineScan& scan)
 {
     int         SChar = -1;
     int         EChar = -1;
@@ -763,6 +824,7 @@ static int DecodeLine (bool afterSlash, int offset, char* pLineData, char *pLine
         if (EChar >= 0)
         {
             InputStruct* pItem = ExtractCCmt(offset, 0, EChar, pLineData, pLineState, CCom);
+            scan.forget();
 
             if (pItem == NULL)
                 return DecodeLineCleanUp (pInputQueue);
@@ -791,10 +853,10 @@ static int DecodeLine (bool afterSlash, int offset, char* pLineData, char *pLine
     // N.B Place this function here as to sure not to corrupt relative pointer
     // settings that may be used within pLinedata, and become altered through
     // using this routine.
-    offset += StripSpacingLeftRight (pLineData, pLineState);
+    offset += StripLineSpacing (scan, pLineData, pLineState);
 
     //@@@@@@ Extract /* comment */ C type comments on one line
-    SChar = FindStartofComment (pLineState);  // find start of C Comment
+    SChar = FindInLine (scan, scanComment, pLineData, pLineState);  // find start of C Comment
     if (SChar >= 0)
     {
         //##### Check if there is a ending C terminator comment string
@@ -804,6 +866,7 @@ static int DecodeLine (bool afterSlash, int offset, char* pLineData, char *pLine
         if (EChar < 0)
         {
             InputStruct* pItem = ExtractCCmt(offset, SChar, -1, pLineData, pLineState, CCom);
+            scan.forget();
 
             if (pItem == NULL)
                 return DecodeLineCleanUp (pInputQueue);
@@ -814,7 +877,7 @@ static int DecodeLine (bool afterSlash, int offset, char* pLineData, char *pLine
 
             // apply recursion so that comment is last item placed
             // in queue !
-            if (DecodeLine (afterSlash, offset, pLineData, pLineState, pInputQueue) != 0)
+            if (DecodeLine (afterSlash, offset, pLineData, pLineState, pInputQueue, scan) != 0)
             {
                 // problems !
                 delete[] pItem -> pData;
@@ -838,13 +901,14 @@ static int DecodeLine (bool afterSlash, int offset, char* pLineData, char *pLine
         else if (!isContinuation(commentLen, pLineData, pLineState))
         {
             InputStruct* pItem = ExtractCCmt(offset, SChar, EChar, pLineData, pLineState, CCom);
+            scan.forget();
 
             if (pItem == NULL)
                 return DecodeLineCleanUp (pInputQueue);
 
             if (ExtractedCCmtFragment(pLineData, pItem))
             {
-                if (DecodeLine (afterSlash, offset, pLineData, pLineState, pInputQueue) != 0)
+                if (DecodeLine (afterSlash, offset, pLineData, pLineState, pInputQueue, scan) != 0)
                     return DecodeLineCleanUp(pInputQueue);
                 TRACE_INPUT(pItem)
                 pInputQueue->putLast (pItem);
@@ -861,21 +925,22 @@ static int DecodeLine (bool afterSlash, int offset, char* pLineData, char *pLine
     }//##### If "/*" C comments present
 
     //##### Remove blank spacing from left & right of string
-    offset += StripSpacingLeftRight (pLineData, pLineState);
+    offset += StripLineSpacing (scan, pLineData, pLineState);
 
     //@@@@@@ C++ Comment Processing !
-    SChar = FindStartofComment (pLineState, Ignore);
+    SChar = FindInLine (scan, scanIgnore, pLineData, pLineState);
     if (SChar >= 0)
     {
         int myoff = offset;
         InputStruct* pItem = ExtractCCmt(myoff, SChar, -1, pLineData, pLineState, CppCom);
+        scan.forget();
 
         if (pItem == NULL)
             return DecodeLineCleanUp (pInputQueue);
 
         if (ExtractedCCmtFragment(pLineData, pItem))
         {
-            if (DecodeLine (afterSlash, offset, pLineData, pLineState, pInputQueue) != 0)
+            if (DecodeLine (afterSlash, offset, pLineData, pLineState, pInputQueue, scan) != 0)
                 return DecodeLineCleanUp(pInputQueue);
             TRACE_INPUT(pItem)
             pInputQueue->putLast (pItem);
@@ -889,7 +954,7 @@ static int DecodeLine (bool afterSlash, int offset, char* pLineData, char *pLine
     }
 
     //##### Remove blank spacing from left & right of string
-    offset += StripSpacingLeftRight (pLineData, pLineState);
+    offset += StripLineSpacing (scan, pLineData, pLineState);
 
     //@@@@@@ #define (preprocessor extraction)
     if (pLineState[0] == POUNDC)
@@ -909,12 +974,12 @@ static int DecodeLine (bool afterSlash, int offset, char* pLineData, char *pLine
 
     //################# Actual Code Extraction #################
 
-    offset += StripSpacingLeftRight (pLineData, pLineState);
+    offset += StripLineSpacing (scan, pLineData, pLineState);
 
     //@@@@@@ Test what's left in line for L_CURL, and R_CURL braces
 
-    SChar = FindPunctuation(pLineData, pLineState, L_CURL);
-    EChar = FindPunctuation(pLineData, pLineState, R_CURL);
+    SChar = FindInLine(scan, scanLCurl, pLineData, pLineState);
+    EChar = FindInLine(scan, scanRCurl, pLineData, pLineState);
 
     Boolean testEnumType = False;
     if ( ((SChar >= 0) && (EChar >= 0)) && (SChar < EChar))
@@ -922,7 +987,9 @@ static int DecodeLine (bool afterSlash, int offset, char* pLineData, char *pLine
         // test to see if there are multiple open/ close braces in enum
         // selective range
         // i.e. { if ( a == b ) { b = c } else { d = e } }
-        int OBrace2 = FindPunctuation(pLineData+SChar+1, pLineState+SChar+1, L_CURL);
+        int OBrace2 = FindInLine(scan, scanLCurl, pLineData, pLineState, SChar+1);
+        if (OBrace2 >= 0)
+            OBrace2 -= SChar+1;
 
         if ( (OBrace2 < 0) || ((OBrace2 > EChar) && (OBrace2 >= 0)) )
            testEnumType = True;
@@ -955,18 +1022,18 @@ static int DecodeLine (bool afterSlash, int offset, char* pLineData, char *pLine
 
         pLineData[EChar]   = saveData;
         pLineState[EChar]  = saveState;
-        splitContinuation(pTemp, pLineData, pLineState, afterSlash);
+        splitContinuation(pTemp, pLineData, pLineState, scan, afterSlash);
 
         TRACE_INPUT(pTemp)
         pInputQueue->putLast (pTemp);
 
         offset += EChar;
-        ShiftLeft (pLineData,  EChar);
-        ShiftLeft (pLineState, EChar);
+        pLineData  += EChar;
+        pLineState += EChar;
 
         // restart decoding line !
-        return DecodeLine (afterSlash, offset, pLineData, pLineState, pInputQueue);
-        // end of recursive call !
+        return 1;
+        // continue with the rest of the line !
 
     } // if L_CURL and R_CURL exist on same line
 
@@ -1007,7 +1074,7 @@ static int DecodeLine (bool afterSlash, int offset, char* pLineData, char *pLine
 
            pLineData[toSave]  = saveCode;
            pLineState[toSave] = saveFlag;
-           splitContinuation(pLeadCode, pLineData+toSave+1, pLineState+toSave+1, afterSlash);
+           splitContinuation(pLeadCode, pLineData+toSave+1, pLineState+toSave+1, scan, afterSlash);
 
            TRACE_INPUT(pLeadCode)
            pInputQueue->putLast (pLeadCode);
@@ -1016,9 +1083,12 @@ static int DecodeLine (bool afterSlash, int offset, char* pLineData, char *pLine
 
         //##### Update main string
         offset += toSave;
-        pLineData[toSave]  = saveCode; ShiftLeft (pLineData,  toSave);
-        pLineState[toSave] = saveFlag; ShiftLeft (pLineState, toSave);
-        TrimContinuation(pLineData, pLineState);
+        pLineData[toSave]  = saveCode; pLineData  += toSave;
+        pLineState[toSave] = saveFlag; pLineState += toSave;
+
+        size_t escape;
+        if (LineContinues(scan, escape, pLineData, pLineState))
+            scan.pEnd = pLineData + TrimContinuation(pLineData, pLineState, escape) + 1;
 
         // extract open/closing brace from code, and place brace as separate
         // line from code. And create new structure for code
@@ -1042,10 +1112,10 @@ static int DecodeLine (bool afterSlash, int offset, char* pLineData, char *pLine
                     pTemp        = ExtractCode (offset, pLineData, pLineState, OBrace);//##### Define data type before storing
 
                     offset += 1;
-                    pLineData[1] = saveCode;  ShiftLeft (pLineData,  1);
-                    pLineState[1] = saveFlag; ShiftLeft (pLineState, 1);
+                    pLineData[1] = saveCode;  pLineData  += 1;
+                    pLineState[1] = saveFlag; pLineState += 1;
 
-                    splitContinuation(pTemp, pLineData, pLineState, afterSlash);
+                    splitContinuation(pTemp, pLineData, pLineState, scan, afterSlash);
                     extractMode  = 3;            // apply recursive extraction
 
                     break;
@@ -1059,8 +1129,8 @@ static int DecodeLine (bool afterSlash, int offset, char* pLineData, char *pLine
                     //@@@@@@ Test what's left in line for L_CURL, and R_CURL braces
 
                     // start one after first char !
-                    SChar = FindPunctuation(pLineData+1, pLineState+1, L_CURL);
-                    EChar = FindPunctuation(pLineData+1, pLineState+1, R_CURL);
+                    SChar = FindInLine(scan, scanLCurl, pLineData, pLineState, 1);
+                    EChar = FindInLine(scan, scanRCurl, pLineData, pLineState, 1);
 
                     if ((SChar >= 0) || (EChar >= 0))
                     {
@@ -1076,16 +1146,16 @@ static int DecodeLine (bool afterSlash, int offset, char* pLineData, char *pLine
                         pTemp = ExtractCode (offset, pLineData, pLineState, CBrace);
 
                         offset += mark;
-                        pLineData[mark] = saveCode;  ShiftLeft (pLineData,  mark);
-                        pLineState[mark] = saveFlag; ShiftLeft (pLineState, mark);
+                        pLineData[mark] = saveCode;  pLineData  += mark;
+                        pLineState[mark] = saveFlag; pLineState += mark;
 
-                        splitContinuation(pTemp, pLineData, pLineState, afterSlash);
+                        splitContinuation(pTemp, pLineData, pLineState, scan, afterSlash);
                         extractMode       = 3;       // apply recursive extraction
                     }
                     else // rest of data is considered as code !
                     {
                         pTemp     = ExtractCode (offset, pLineData, pLineState, CBrace);
-                        splitContinuation(pTemp, pLineData, pLineState, afterSlash);
+                        splitContinuation(pTemp, pLineData, pLineState, scan, afterSlash);
                         pLineState = NULL;      // leave processing !
                     }
                     break;
@@ -1093,8 +1163,8 @@ static int DecodeLine (bool afterSlash, int offset, char* pLineData, char *pLine
 
                 case (3):   // remove what is left on line as code.
                 {
-                    return DecodeLine (afterSlash, offset, pLineData, pLineState, pInputQueue);
-                    // end of recursive call !
+                    return 1;
+                    // continue with the rest of the line !
                 }
             }// switch;
 
@@ -1139,10 +1209,173 @@ static int DecodeLine (bool afterSlash, int offset, char* pLineData, char *pLine
     return 0;  // no worries
 }
 
+// ----------------------------------------------------------------------------
+// This function is a single pass decoder for a line of input code that
+// is read from the user's input file. The function stores each part of a line,
+// be it a comment (with its attributes), code, open brace, close brace, or
+// blank line as a InputStructure, each InputStructure is stored within
+// a Queue Object.
+//
+// Parameters:
+// offset     : offset within original line's text of this component
+// pLineData  : Pointer to a line of a users input file (string).
+// pLineState : Pointer to a state of a users input line (string).
+// QueueList* : Pointer to a QueueList object will contains all of
+//              a lines basic elements. If this object doesn't contain
+//              any elements, then it suggests there was a processing
+//              problem.
+//
+// Return Values:
+// int        : returns a error code.
+//              -1 : Memory allocation failure
+//               0 : No Worries
+//
+static int DecodeLine (bool afterSlash, int offset, char* pLineData, char *pLineState, QueueList* pInputQueue, LineScan& scan)
+{
+    int result;
+
+    // each call takes one or more fragments; loop rather than recurse, since
+    // a long line may have very many
+    while ((result = DecodeFragments (afterSlash, offset, pLineData, pLineState, pInputQueue, scan)) > 0)
+        ;
+    return result;
+}
+
+// ----------------------------------------------------------------------------
+// The comments of the lines most recently written to the output.  Lines are
+// written as soon as no later line can change them, but dontHangComment()
+// still aligns a comment with those of the last Queue_Buffer lines, so it
+// searches these after the lines which are still queued.
+
+class CommentHistory
+{
+        char*   pKind;          // per line: 0 if no comment, else see Add()
+        int*    pOffset;        // per line: offset of the comment
+        int     size;           // lines allocated
+        int     limit;          // most lines kept, Queue_Buffer
+        int     lines;          // lines kept
+        int     newest;         // index of the newest line kept
+
+    public:
+        int     visible;        // newest lines which dontHangComment() sees
+
+        CommentHistory (int queueBuffer)
+            : pKind(0), pOffset(0), size(0), limit(queueBuffer), lines(0), newest(-1), visible(0)
+        {
+        }
+        ~CommentHistory (void)
+        {
+            delete[] pKind;
+            delete[] pOffset;
+        }
+
+        // Forgets every line, as when the output queue is emptied.
+        void Clear (void)
+        {
+            lines   = 0;
+            newest  = -1;
+            visible = 0;
+        }
+
+        // The written lines which dontHangComment() sees: none once the
+        // queue has been emptied, as after a continued preprocessor line.
+        int Count (void) const
+        {
+            return (visible < lines) ? visible : lines;
+        }
+
+        int Add (const OutputStruct* pOut);
+        bool Search (bool& star, int& length) const;
+
+        // use defaults here
+        CommentHistory(const CommentHistory&);
+        CommentHistory& operator=(const CommentHistory&);
+};
+
+// Records a line as it is written.  Returns -1 if memory allocation failed.
+int CommentHistory::Add (const OutputStruct* pOut)
+{
+    if (limit <= 0)
+        return 0;
+
+    if (lines == size && size < limit)
+    {
+        int   grown    = (size != 0) ? ((2 * size < limit) ? 2 * size : limit)
+                                     : ((limit < 64) ? limit : 64);
+        char* pNewKind = new char[grown];
+        int*  pNewOff  = new int[grown];
+
+        if (pNewKind == NULL || pNewOff == NULL)
+        {
+            delete[] pNewKind;
+            delete[] pNewOff;
+            return -1;
+        }
+        // unroll the ring, oldest first
+        for (int n = 0; n < lines; ++n)
+        {
+            int from = (newest - lines + 1 + n + size) % size;
+            pNewKind[n] = pKind[from];
+            pNewOff[n]  = pOffset[from];
+        }
+        delete[] pKind;
+        delete[] pOffset;
+        pKind   = pNewKind;
+        pOffset = pNewOff;
+        newest  = lines - 1;
+        size    = grown;
+    }
+
+    char kind = 0;              // no comment
+    if (pOut -> pComment != NULL)
+    {
+        const char *text = SkipBlanks(pOut -> pComment);
+        if (!strncmp(text, ccom_begin, 2))
+            kind = '/';         // begins a comment
+        else if (*text == '*')
+            kind = '*';         // continues the stars of a comment
+        else
+            kind = ' ';         // any other comment text
+    }
+
+    newest = (newest + 1) % size;
+    pKind[newest]   = kind;
+    pOffset[newest] = pOut -> offset;
+    if (lines < size)
+        lines++;
+    return 0;
+}
+
+// Continues the search of dontHangComment() through the visible lines, newest
+// first, for the line which began the comment.  Returns true if it was found.
+bool CommentHistory::Search (bool& star, int& length) const
+{
+    for (int n = 0; n < Count(); ++n)
+    {
+        int line = (newest - n + size) % size;
+        switch (pKind[line])
+        {
+            case '/':
+                if (!star)
+                {
+                    if (length > pOffset[line])
+                        length = pOffset[line];
+                }
+                return true;
+            case ' ':
+                star = False;
+                break;
+            default:
+                break;
+        }
+    }
+    return false;
+}
+
 // If the comment (fragment) doesn't begin a comment, we may be continuing
 // a multi-line comment.  Adjust its indention to line up with the beginning
 // to avoid a hanging-indent appearance.
-static void dontHangComment(InputStruct *pIn, OutputStruct *pOut, QueueList* pLines)
+static void dontHangComment(InputStruct *pIn, OutputStruct *pOut, QueueList* pLines, const CommentHistory& history)
 {
     if (pIn -> dataType == CCom
      && strncmp(pOut -> pComment, ccom_begin, 2) != 0)
@@ -1153,9 +1386,10 @@ static void dontHangComment(InputStruct *pIn, OutputStruct *pOut, QueueList* pLi
 
         // If the comment text begins with an '*', increase the indention by
         // one unless it follows a comment-line that didn't begin with '*'.
-        if (count > 0)
+        if (count > 0 || history.Count() > 0)
         {
             bool star = (*text == '*');
+            bool found = false;
 
             while (count > 0)
             {
@@ -1171,11 +1405,14 @@ static void dontHangComment(InputStruct *pIn, OutputStruct *pOut, QueueList* pLi
                         if (length > pTemp -> offset)
                             length = pTemp -> offset;
                     }
+                    found = true;
                     break;
                 }
                 if (*text != '*')
                     star = False;
             }
+            if (!found)
+                history.Search(star, length);
             ShiftLeft(pOut -> pComment, length);
             if (star)
                 pOut -> indentSpace += 1;
@@ -1256,7 +1493,7 @@ static int typeOfPreP(InputStruct *pItem)
 }
 
 // Returns the combination of brace-indent and preprocessor-indent
-static int combinedIndent(int indentStack, int prepStack, Config userS)
+static int combinedIndent(int indentStack, int prepStack, const Config& userS)
 {
     if (prepStack > userS.tabSpaceSize)
         return indentStack + prepStack - userS.tabSpaceSize;
@@ -1374,6 +1611,7 @@ static bool outputWasContinuedPreP (OutputStruct * pOut)
 // Parameters:
 // indentStack : Variable used to show how many spaces/tabs to indent when
 //               creating a new OutputStructure.
+// history     : Comments of the lines already written, for dontHangComment().
 // pInputQueue : Pointer to the InputStructure queue object.
 // pOutputQueue: Pointer to the OutputStructure queue object.
 // userS       : Structure that contains the users config settings.
@@ -1392,15 +1630,27 @@ static int ConstructLine (
     bool& pendingElse,
     HangStruct& hang_state,
     SqlStruct& sql_state,
+    const CommentHistory& history,
     QueueList* pInputQueue,
     QueueList* pOutputQueue,
     const Config& userS)
 {
     InputStruct* pTestType = NULL;
+    OutputStruct* pLastCode = NULL;     // last item in pOutputQueue with code
     char *pendingComment = NULL;
 
     TRACE(("ConstructLine indentStack=%d\n", indentStack));
 
+    for (int p = pOutputQueue -> status(); p > 0; --p)
+    {
+        OutputStruct *pq = reinterpret_cast<OutputStruct*>(pOutputQueue -> peek(p));
+        if (pq != 0 && pq -> pCFlag != 0)
+        {
+            pLastCode = pq;
+            break;
+        }
+    }
+
     while ( pInputQueue->status() > 0 )
     {
         int tokenIndent = indentStack;
@@ -1426,17 +1676,9 @@ static int ConstructLine (
         }
 
         int theType = pTestType -> dataType;
-        for (int p = pOutputQueue -> status(); p > 0; --p)
+        if (outputWasContinuedPreP (pLastCode))
         {
-            OutputStruct *pq = reinterpret_cast<OutputStruct*>(pOutputQueue -> peek(p));
-            if (pq != 0 && pq -> pCFlag != 0)
-            {
-                if (outputWasContinuedPreP (pq))
-                {
-                    theType = PreP;
-                }
-                break;
-            }
+            theType = PreP;
         }
 
         switch (theType)
@@ -1454,7 +1696,7 @@ static int ConstructLine (
                     {
                         // comment after nothing?
                         pOut -> pComment = pTestType -> pData;
-                        dontHangComment(pTestType, pOut, pOutputQueue);
+                        dontHangComment(pTestType, pOut, pOutputQueue, history);
                         break;
                     }
                     if (!inputIsCode(pNextItem))
@@ -1484,7 +1726,6 @@ static int ConstructLine (
                     {
                         pendingComment = pTestType -> pData;
                         TRACE(("@%d, Pending Comment = %s:%d\n", __LINE__, pendingComment, pOut->thisToken));
-                        delete[] pTestType -> pState;
                         delete pTestType;
                         delete pOut;
                         continue;
@@ -1506,7 +1747,7 @@ static int ConstructLine (
                         pOut -> indentSpace   = userS.posOfCommentsNC;
 
                     pOut -> pComment          = pTestType -> pData;
-                    dontHangComment(pTestType, pOut, pOutputQueue);
+                    dontHangComment(pTestType, pOut, pOutputQueue, history);
 
                     TRACE(("@%d, Set Comment = %s:%d indent %d\n", __LINE__, pOut->pComment, pOut->thisToken, pOut->indentSpace));
 
@@ -1629,12 +1870,9 @@ static int ConstructLine (
 
         } // switch
 
-        if (pOut -> pCode == 0
-         && pOut -> pBrace == 0)
-        {
-            delete[] pTestType -> pState;
-        }
-        else if (pendingComment != NULL)
+        if ((pOut -> pCode != 0
+          || pOut -> pBrace != 0)
+         && pendingComment != NULL)
         {
             TRACE(("@%d, Use Pending Comment = %s:%d\n", __LINE__, pendingComment, pOut->thisToken));
             pOut -> pComment = pendingComment;
@@ -1668,6 +1906,8 @@ static int ConstructLine (
         }
 
         pOutputQueue -> putLast (pOut);
+        if (pOut -> pCFlag != 0)
+            pLastCode = pOut;
 
         delete pTestType; // ##### Remove structure from memory, not its data
                           // ##### (i.e., char* pData), this is stored
@@ -1733,48 +1973,47 @@ static bool chainedSingleIndent(StackList* pIMode)
     return result;
 }
 
-// If we've had a chain of single indents before a L_CURL, we have to shift
-// the block to match the indent of the last indented code, because the
-// preceding logic was indenting solely on the basis of curly braces.
-static void shiftToMatchSingleIndent(QueueList* pLines, int indention, int first)
+// Adds "adjust" to the indention of the block whose open brace is at "first",
+// through its closing brace and an "else" which follows it.  Returns the index
+// of the line which ended the block, or zero if the queue ended first.  With
+// no adjustment this only finds how far shiftToMatchSingleIndent() would go.
+static int shiftSingleIndentBlock(QueueList* pLines, int first, int adjust)
 {
     int baseIn = (reinterpret_cast<OutputStruct*>(pLines -> peek (first))) -> indentSpace;
-    int adjust = indention - baseIn;
     int state = 0;
 
-    if (adjust > 0)
+    for (int i = first; i <= pLines -> status() ; i++)
     {
-        TRACE(("shiftToMatchSingleIndent, base %d adj %d\n", baseIn, adjust));
-        for (int i = first; i <= pLines -> status() ; i++)
-        {
-            OutputStruct* pAlterLine  = reinterpret_cast<OutputStruct*>(pLines -> peek (i));
-            if (pAlterLine == 0)
-                break;
+        OutputStruct* pAlterLine  = reinterpret_cast<OutputStruct*>(pLines -> peek (i));
+        if (pAlterLine == 0)
+            break;
 
-            // If there's an "else" immediately after the block-else, shift
-            // it also.
-            if (state == 1)
-            {
-                if (pAlterLine -> pCode == 0
-                 || !BeginsElseClause(pAlterLine))
-                    break;
-                state = 2;
-            }
-            else
-            if (pAlterLine -> pCode != 0)
-            {
-                if (pAlterLine -> pType == PreP)
-                    continue;
-            }
-            else
-            if (pAlterLine -> pBrace == 0)
-            {
+        // If there's an "else" immediately after the block-else, shift
+        // it also.
+        if (state == 1)
+        {
+            if (pAlterLine -> pCode == 0
+             || !BeginsElseClause(pAlterLine))
+                return i;
+            state = 2;
+        }
+        else
+        if (pAlterLine -> pCode != 0)
+        {
+            if (pAlterLine -> pType == PreP)
                 continue;
-            }
+        }
+        else
+        if (pAlterLine -> pBrace == 0)
+        {
+            continue;
+        }
 
-            if (pAlterLine -> indentSpace < baseIn)
-                break;
+        if (pAlterLine -> indentSpace < baseIn)
+            return i;
 
+        if (adjust != 0)
+        {
             TRACE(("...shift %2d %2d :%s\n",
                 pAlterLine -> indentSpace,
                 pAlterLine -> indentSpace + adjust,
@@ -1783,18 +2022,34 @@ static void shiftToMatchSingleIndent(QueueList* pLines, int indention, int first
                     : pAlterLine -> pBrace));
 
             pAlterLine -> indentSpace += adjust;
+        }
 
-            if (pAlterLine -> indentSpace <= baseIn + adjust
-             && pAlterLine -> pBrace != 0
-             && pAlterLine -> pBrace[0] == R_CURL)
-            {
-                if (state == 0)
-                    state = 1;
-                else
-                    break;
-            }
+        if (pAlterLine -> indentSpace <= baseIn + adjust
+         && pAlterLine -> pBrace != 0
+         && pAlterLine -> pBrace[0] == R_CURL)
+        {
+            if (state == 0)
+                state = 1;
+            else
+                return i;
         }
     }
+    return 0;
+}
+
+// If we've had a chain of single indents before a L_CURL, we have to shift
+// the block to match the indent of the last indented code, because the
+// preceding logic was indenting solely on the basis of curly braces.
+static void shiftToMatchSingleIndent(QueueList* pLines, int indention, int first)
+{
+    int baseIn = (reinterpret_cast<OutputStruct*>(pLines -> peek (first))) -> indentSpace;
+    int adjust = indention - baseIn;
+
+    if (adjust > 0)
+    {
+        TRACE(("shiftToMatchSingleIndent, base %d adj %d\n", baseIn, adjust));
+        shiftSingleIndentBlock(pLines, first, adjust);
+    }
 }
 
 // check if an output-struct contains code, so we can distinguish it from
@@ -2437,14 +2692,35 @@ static int LookupLastKeyword(OutputStruct* pCodeLine)
 }
 
 // ----------------------------------------------------------------------------
-// Find the index for the first word on the code line, or the first character
-// if the line does not begin with a word.  Returns true if we found something.
-#ifdef TEST_BCPP
-static bool parseFirstCode(OutputStruct* pCodeLine, char &firstchar, int &firstword, int &wordsize)
+// Check if a left curly-brace may be joined to the end of the code line, i.e.,
+// after a right-paren, equals, or one of the keywords in KeyBeforeBrace().
+// Lines which cannot be parsed are assumed to take the brace.
+static bool JoinsLCurly(OutputStruct* pCodeLine)
 {
-    bool result = false;
+    int lastword;
+    int wordsize;
+    char lastchar;
 
-    firstword = -1;
+    if (parseLastCode(pCodeLine, lastchar, lastword, wordsize))
+    {
+        if (lastchar != R_PAREN
+         && lastchar != '='
+         && (lastword < 0
+          || KeyBeforeBrace(pCodeLine->pCode + lastword, wordsize) == False))
+            return false;
+    }
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+// Find the index for the first word on the code line, or the first character
+// if the line does not begin with a word.  Returns true if we found something.
+#ifdef TEST_BCPP
+static bool parseFirstCode(OutputStruct* pCodeLine, char &firstchar, int &firstword, int &wordsize)
+{
+    bool result = false;
+
+    firstword = -1;
     wordsize = 0;
     firstchar = NullC;
 
@@ -2570,21 +2846,9 @@ static QueueList* ReformatLCurly (QueueList* pLines, int first, const Config& us
         {
             splitBraces = True;
         }
-        else
+        else if (!JoinsLCurly(pCodeLine))
         {
-            int lastword;
-            int wordsize;
-            char lastchar;
-
-            if (parseLastCode(pCodeLine, lastchar, lastword, wordsize))
-            {
-                // we can join a left-curly after a right-paren, equals, or "else"
-                if (lastchar != R_PAREN
-                 && lastchar != '='
-                 && (lastword < 0
-                  || KeyBeforeBrace(pCodeLine->pCode + lastword, wordsize) == False))
-                    splitBraces = True;
-            }
+            splitBraces = True;
         }
 
         // place top-level open braces on same line as code
@@ -2631,8 +2895,8 @@ static QueueList* ReformatLCurly (QueueList* pLines, int first, const Config& us
         pNewItem = new OutputStruct(pCodeLine);
         // code + space + brace + nullc
         int newLen = (strlen (pCodeLine->pCode) + strlen (pBraceLine->pBrace) + 1 + 1);
-        char *pNewCode  = new char [newLen];
-        char *pNewState  = new char [newLen];
+        char *pNewCode  = new char [2 * newLen];   // with its state-flags
+        char *pNewState = pNewCode + newLen;
 
         if ((pNewItem == NULL) || (pNewCode == NULL))
         {
@@ -2846,8 +3110,8 @@ static QueueList* ReformatRCurly (QueueList* pLines, int first, const Config& us
 
         // code + space + brace + nullc
         int newLen = (strlen (pCodeLine->pCode) + strlen (pBraceLine->pBrace) + 1 + 1);
-        char *pNewCode  = new char [newLen];
-        char *pNewState  = new char [newLen];
+        char *pNewCode  = new char [2 * newLen];   // with its state-flags
+        char *pNewState = pNewCode + newLen;
 
         if ((pNewItem == NULL) || (pNewCode == NULL))
         {
@@ -3055,6 +3319,75 @@ static Boolean adjustLeadingSpaces(int fillMode, char *&notes, int &leading)
     return False;
 }
 
+// ----------------------------------------------------------------------------
+// Function determines how many lines at the end of the output queue must be
+// held back, because a line that has not been read yet may still alter them.
+// The lines before those can be written immediately.
+//
+// Parameters:
+// pLines    : Pointer to the OutputStructures queue object
+// pIMode    : Pointer to indent type stack.
+// userS     : Users configuration settings.
+//
+// Return Values:
+// int       : Number of lines to hold, counted from the end of the queue.
+//
+static int LookaheadNeeded (QueueList* pLines, StackList* pIMode, const Config& userS)
+{
+    int count  = pLines -> status();
+    int held   = 1;             // IndentNonBraces() looks at the next line
+    int n;
+
+    // The last code line may take a brace from a following line (see
+    // ReformatLCurly), or be a continued preprocessor line which changes the
+    // type of the next one (see ConstructLine).  Hold it, and the blank or
+    // comment lines after it, until more code arrives.
+    for (n = count; n > 0; --n)
+    {
+        OutputStruct* pOut = reinterpret_cast<OutputStruct*>(pLines -> peek (n));
+        if (pOut -> pCode != NULL)
+        {
+            if (outputWasContinuedPreP(pOut)
+             || ((userS.topBraceLoc == False || userS.braceLoc == False)
+              && !isPreProc(pOut)
+              && JoinsLCurly(pOut)))
+            {
+                if (held < count - n + 1)
+                    held = count - n + 1;
+            }
+            break;
+        }
+    }
+
+    // A single-indented line followed by a block may shift the whole block
+    // (see shiftToMatchSingleIndent), up to its closing brace and a following
+    // "else", passing over preprocessor lines.  Hold the queue until all of
+    // that has been read.  Since peekIndexOBrace() skips close braces as well
+    // as comments and blank lines, the block may begin after any number of
+    // those.
+    IndentStruct* pIndent = reinterpret_cast<IndentStruct*>(pIMode -> peek (1));
+    if (pIndent != NULL
+     && pIndent -> attrib == oneLine
+     && (reinterpret_cast<OutputStruct*>(pLines -> peek (1))) -> pCode != NULL)
+    {
+        int block = peekIndexOBrace(pLines, 2);
+        if (block == 0)
+        {
+            for (n = 2; n <= count; ++n)
+            {
+                if ((reinterpret_cast<OutputStruct*>(pLines -> peek (n))) -> pCode != NULL)
+                    break;
+            }
+            if (n > count)      // no code yet, so a block may still follow
+                held = count;
+        }
+        else if (shiftSingleIndentBlock(pLines, block, 0) == 0)
+            held = count;
+    }
+
+    return held;
+}
+
 // ----------------------------------------------------------------------------
 // Function is used to expand OutputStructures contained within a queue to the
 // user's output file.  Function also reformats braces, function spacing,
@@ -3065,8 +3398,10 @@ static Boolean adjustLeadingSpaces(int fillMode, char *&notes, int &leading)
 // pLines    : Pointer to the OutputStructures queue object
 // FuncVar   : See FunctionSpacing()
 // userS     : Users configuration settings.
-// stopLimit : Defines how many OutputStructures remain within the Queue not
-//             processed.
+// stopLimit : Defines the most OutputStructures which may remain within the
+//             Queue not processed.  Fewer are kept if LookaheadNeeded() finds
+//             no reason to hold them, and all are processed if it is zero.
+// history   : Records the comment of each line written.
 // pendingBlank : is used to control consecutive blank lines
 //
 // Return Values:
@@ -3075,34 +3410,15 @@ static Boolean adjustLeadingSpaces(int fillMode, char *&notes, int &leading)
 //
 // returns NULL if memory allocation failed
 //
-static QueueList* OutputToOutFile (FILE* pOutFile, QueueList* pLines, StackList* pIMode, int& FuncVar, const Config& userS, int stopLimit, int &pendingBlank)
+static QueueList* OutputToOutFile (FILE* pOutFile, QueueList* pLines, StackList* pIMode, int& FuncVar, const Config& userS, int stopLimit, CommentHistory& history, int &pendingBlank)
 {
     OutputStruct* pOut         = NULL;
-    char*         pIndentation = NULL;
-    char*         pFiller      = NULL;
-    int           fillMode     = 2; // we can always use spaces
+    const int     fillMode     = userS.fillMode;
     bool          inBraces;
 
-    // determine fill mode
-    if (userS.useTabs == True)
-        fillMode |= 1;          // set bit 0, tabs
-
-    while (pLines -> status() > stopLimit) // stopLimit is used to search backward for L_CURL
+    while (pLines -> status() > 0)
     {
-        // process function spacing !!!!!
-        int testProcessing = pLines -> status();
-
-        FunctionSpacing (pLines, userS, FuncVar, pendingBlank, inBraces );
-
-        if (pLines -> status () < testProcessing) // line removed, test next line in buffer
-             continue;
-
-        // check indentation on case statements etc
-        pLines = IndentNonBraces (pIMode, pLines, userS);
-        if (pLines == NULL)
-             return NULL;               //#### Memory Allocation Failure
-
-        // reformat open braces if user option set
+        // reformat open braces if user option set, as soon as they are read
         if (userS.topBraceLoc == False  // place open braces on same line as code
          || userS.braceLoc == False)    // place open braces on same line as code
         {
@@ -3119,10 +3435,35 @@ static QueueList* OutputToOutFile (FILE* pOutFile, QueueList* pLines, StackList*
         }
 #endif
 
+        // keep only the lines which a following line may still alter
+        if (pLines -> status() <= stopLimit
+         && pLines -> status() <= LookaheadNeeded(pLines, pIMode, userS))
+            break;
+
+        // process function spacing !!!!!
+        int testProcessing = pLines -> status();
+
+        FunctionSpacing (pLines, userS, FuncVar, pendingBlank, inBraces );
+
+        if (pLines -> status () < testProcessing) // line removed, test next line in buffer
+             continue;
+
+        // check indentation on case statements etc
+        pLines = IndentNonBraces (pIMode, pLines, userS);
+        if (pLines == NULL)
+             return NULL;               //#### Memory Allocation Failure
+
         pOut = reinterpret_cast<OutputStruct*>(pLines -> takeNext());
 
         TRACE_OUTPUT(pOut);
 
+        if (history.Add(pOut) != 0)
+        {
+            delete pOut;
+            delete pLines;
+            return NULL;                //#### Memory Allocation Failure
+        }
+
         // expand pOut structure to print to the output file
         if (!emptyString(pOut -> pCode)
          || !emptyString(pOut -> pBrace)
@@ -3146,9 +3487,7 @@ static QueueList* OutputToOutFile (FILE* pOutFile, QueueList* pLines, StackList*
              && strncmp(notes, cppc_begin, 2))
              {
                 adjustLeadingSpaces(fillMode, notes, leading);
-                pIndentation = TabSpacing (fillMode,  0, leading, userS.tabSpaceSize);
-                fprintf (pOutFile, "%s", pIndentation);
-                delete[] pIndentation;
+                WriteSpacing (pOutFile, userS, 0, leading);
 
                 fprintf (pOutFile, "%s\n", notes);
                 notes = NULL;
@@ -3187,21 +3526,14 @@ static QueueList* OutputToOutFile (FILE* pOutFile, QueueList* pLines, StackList*
                     }
                 }
 
-                if (ContinuedQuote(pOut))
-                    pIndentation = NULL;
-                else
+                bool indented = !ContinuedQuote(pOut);
+                if (indented && isPreproLine(pOut))
                 {
-                    if (isPreproLine(pOut))
-                    {
-                        int next = pOut->preproLevel;
-                        if (next > 0 && BeginsCurly(pOut))
-                            --next;
-                        leading += next * userS.tabSpaceSize;
-                    }
-
-                    pIndentation = TabSpacing (fillMode,  0, leading, userS.tabSpaceSize);
+                    int next = pOut->preproLevel;
+                    if (next > 0 && BeginsCurly(pOut))
+                        --next;
+                    leading += next * userS.tabSpaceSize;
                 }
-                pFiller = TabSpacing (fillMode, mark, pOut -> filler, userS.tabSpaceSize);
 
                 if (pendingBlank != 0)
                 {
@@ -3221,11 +3553,8 @@ static QueueList* OutputToOutFile (FILE* pOutFile, QueueList* pLines, StackList*
                 }
 
                 // Output data
-                if (pIndentation != NULL)
-                {
-                    fprintf (pOutFile, "%s", pIndentation);
-                    delete[] pIndentation;
-                }
+                if (indented)
+                    WriteSpacing (pOutFile, userS, 0, leading);
 
                 if (pOut -> pCode != NULL)
                     fprintf (pOutFile, "%s", pOut -> pCode);
@@ -3233,11 +3562,7 @@ static QueueList* OutputToOutFile (FILE* pOutFile, QueueList* pLines, StackList*
                 if (pOut -> pBrace != NULL)
                     fprintf (pOutFile, "%s", pOut -> pBrace);
 
-                if (pFiller != NULL)
-                {
-                    fprintf (pOutFile, "%s", pFiller);
-                    delete[] pFiller;
-                }
+                WriteSpacing (pOutFile, userS, mark, pOut -> filler);
 
                 if (notes != NULL)
                 {
@@ -3257,6 +3582,10 @@ static QueueList* OutputToOutFile (FILE* pOutFile, QueueList* pLines, StackList*
         delete pOut;
     }
 
+    // with nothing held, no line written so far is in the window either
+    if (stopLimit == 0)
+        history.Clear();
+
     return pLines;
 }
 
@@ -3297,6 +3626,362 @@ static unsigned long int GetStartEndTime (int mode)
     return 0;
 }
 
+// ----------------------------------------------------------------------------
+// Shows the message for an error from ProcessFile() or FormatDecoded(), and
+// returns it.
+static int ReportProcessError (int errorCode, unsigned long lineNo)
+{
+    switch (errorCode)
+    {
+        case (-1):
+            warning ("%s", "\n\n#### ERROR ! Memory Allocation Failed\n");
+            break;
+
+        case (-2): // Construct line failed !
+            // output final line position
+            warning ("\nLast Line Read %lu", lineNo);
+            break;
+
+        default:
+            warning ("\nSomething Weird %d\n", errorCode);
+            break;
+    }
+    return errorCode;
+}
+
+// ----------------------------------------------------------------------------
+// The front-end of the formatter reads each line of the input, and splits it
+// into the fragments which ConstructLine() uses (ExpandTabs and DecodeLine).
+// The only settings it uses are those compared by SameDecoding().
+
+enum LineKind
+{
+    lkEnd = 0,          // no more input
+    lkNone,             // nothing to format on this line
+    lkCode,             // the input queue holds the line's fragments
+    lkHtmlFirst,        // pText is the line which begins an HTML region
+    lkHtml,             // pText is a following line of the HTML region
+    lkError             // memory allocation failure
+};
+
+#define MY_DEFAULT \
+        pInFile(pFile), \
+        userS(settings), \
+        EndOfFile(0), \
+        pData(0), \
+        lineState(0), \
+        curState(Blank), \
+        codeOnLine(False), \
+        beforeSlash(false), \
+        inHtml(false), \
+        html_state(), \
+        lineNo(0), \
+        pText(0)
+
+class LineDecoder
+{
+        FILE*           pInFile;
+        const Config&   userS;
+        int             EndOfFile;      // Var used by readline() to show eof has been reached
+        char*           pData;
+        char*           lineState;
+        CharState       curState;
+        Boolean         codeOnLine;
+        bool            beforeSlash;
+        bool            inHtml;         // reading the lines of an HTML region
+        HtmlStruct      html_state;
+
+    public:
+        unsigned long   lineNo;         // lines read
+        const char*     pText;          // the line, for lkHtml and lkHtmlFirst
+
+        LineDecoder (FILE* pFile, const Config& settings)
+            : MY_DEFAULT
+        {
+        }
+        ~LineDecoder (void)
+        {
+            delete[] pData;
+            delete[] lineState;
+        }
+        LineKind Next (QueueList* pInputQueue);
+
+        // use defaults here
+        LineDecoder(const LineDecoder&);
+        LineDecoder& operator=(const LineDecoder&);
+};
+
+#undef MY_DEFAULT
+
+// ----------------------------------------------------------------------------
+// Reads the next line of the input, and decodes it into the input queue.
+//
+// Parameters:
+// pInputQueue : Pointer to an empty queue, for the InputStructures.
+//
+// Return Values:
+// LineKind    : What was read, see above.
+//
+LineKind LineDecoder::Next (QueueList* pInputQueue)
+{
+    if (inHtml)
+    {
+        if ((pText = html_state.NextHtml(pInFile, EndOfFile)) != NULL)
+        {
+            lineNo++;
+            return lkHtml;
+        }
+        inHtml = false;
+    }
+
+    if (EndOfFile)
+        return lkEnd;
+
+    delete[] pData;
+    delete[] lineState;
+    lineState = NULL;
+
+    if ((pData = ReadLine (pInFile, EndOfFile)) == NULL)
+        return lkNone;
+
+    lineNo++;
+    traceLine (lineNo);
+
+    if (html_state.Active(pData))
+    {
+        if (EndOfFile)
+            return lkEnd;
+        // the rest of the HTML region is read as-is, by NextHtml()
+        pText = pData;
+        inHtml = true;
+        return lkHtmlFirst;
+    }
+
+    ExpandTabs (pData,
+        userS.tabSpaceSize,
+        userS.deleteHighChars,
+        userS.quoteChars,
+        curState, lineState, codeOnLine);
+    if (pData == NULL)
+        return lkError;
+
+    bool   afterSlash = beforeSlash;
+    size_t beforeSize;
+    beforeSlash = isContinuation(beforeSize, pData, lineState);
+
+    LineScan scan;
+    if (DecodeLine (afterSlash, 0, pData, lineState, pInputQueue, scan) != 0)
+        return lkNone;
+    return lkCode;
+}
+
+// ----------------------------------------------------------------------------
+// The back-end of the formatter builds output lines from the fragments of
+// each input line (ConstructLine), and writes those which a later line can no
+// longer change (OutputToOutFile).  Everything that is carried from one line
+// to the next, apart from the decoding, is kept here, so that a file which is
+// decoded once can be fed to several of these.
+
+#define MY_DEFAULT \
+        pOutFile(pFile), \
+        userS(settings), \
+        pOutputQueue(new QueueList()), \
+        pIMode(new StackList()), \
+        FuncVar(0), \
+        pendingBlank(0), \
+        indentStack(0), \
+        indentStack2(0), \
+        indentPreP(False), \
+        pendingElse(False), \
+        prepStack(0), \
+        bracesLevel(0), \
+        preproLevel(0), \
+        in_prepro(0), \
+        hang_state(), \
+        sql_state(), \
+        history(settings.queueBuffer), \
+        maxLookahead(0)
+
+class LineBuilder
+{
+        FILE*           pOutFile;
+        const Config&   userS;
+        QueueList*      pOutputQueue;
+        StackList*      pIMode;
+        int             FuncVar;        // variable used in processing function spacing !
+        int             pendingBlank;   // var used to control blank lines
+        int             indentStack;    // var used for brace spacing
+        int             indentStack2;   // save/restore "indentStack" for preprocessor lines
+        bool            indentPreP;
+        bool            pendingElse;
+        int             prepStack;
+        int             bracesLevel;
+        int             preproLevel;
+        int             in_prepro;
+        HangStruct      hang_state;
+        SqlStruct       sql_state;
+        CommentHistory  history;        // comments of lines already written
+
+    public:
+        int             maxLookahead;   // most lines held in the output queue
+
+        LineBuilder (FILE* pFile, const Config& settings)
+            : MY_DEFAULT
+        {
+        }
+        ~LineBuilder (void)
+        {
+            delete pOutputQueue;
+            delete pIMode;
+        }
+        bool Ready (void) const
+        {
+            return (pOutputQueue != NULL) && (pIMode != NULL);
+        }
+        int AddLine (QueueList* pInputQueue);
+        int AddHtml (const char* pText, bool flush);
+        int Finish (void);
+
+        // use defaults here
+        LineBuilder(const LineBuilder&);
+        LineBuilder& operator=(const LineBuilder&);
+};
+
+#undef MY_DEFAULT
+
+// ----------------------------------------------------------------------------
+// Builds the output lines for one decoded input line, and writes those which
+// no longer need to be held.
+//
+// Parameters:
+// pInputQueue : Pointer to the line's InputStructures, which are taken.
+//
+// Return Values:
+// int         : 0 = no worries, -1 = memory allocation failure,
+//               -2 = line construction failure, as for ConstructLine().
+//
+int LineBuilder::AddLine (QueueList* pInputQueue)
+{
+    int old_prepro = in_prepro;
+    bool restoreit = False;
+
+    if ((in_prepro = beginningPrePro(pInputQueue, in_prepro)) != 0)
+    {
+        if (in_prepro == 1)
+        {
+            TRACE(("save indentStack: %d (%d)\n", in_prepro, indentStack));
+            indentStack2 = indentStack;
+        }
+        else if (in_prepro == 2)
+        {
+            TRACE(("increase indentStack\n"));
+            indentStack += userS.tabSpaceSize;
+        }
+    }
+    else if (old_prepro)
+    {
+        restoreit = True;
+        if (old_prepro == 1)
+            indentStack += userS.tabSpaceSize;
+    }
+
+    // The lines held and those written most recently make up a window of
+    // Queue_Buffer lines, as when every line was held that long.
+    history.visible = userS.queueBuffer - pOutputQueue -> status();
+
+    int errorCode = ConstructLine (
+            indentPreP,
+            prepStack,
+            bracesLevel,
+            preproLevel,
+            indentStack,
+            pendingElse,
+            hang_state,
+            sql_state,
+            history,
+            pInputQueue,
+            pOutputQueue,
+            userS);
+
+    if (errorCode != 0)
+        return errorCode;
+
+    pOutputQueue = OutputToOutFile (
+                pOutFile,
+                pOutputQueue,
+                pIMode,
+                FuncVar,
+                userS,
+                restoreit ? 0 : userS.queueBuffer,
+                history,
+                pendingBlank );
+
+    if (pOutputQueue == NULL)
+        return -1; // memory allocation error !
+
+    if (pOutputQueue -> status() > maxLookahead)
+        maxLookahead = pOutputQueue -> status();
+
+    if (restoreit)
+    {
+        TRACE(("restore indentStack (%d) to %d\n", indentStack, indentStack2));
+        if (indentStack != 0)
+        {
+            pIMode -> pop();
+        }
+        indentStack = indentStack2;
+    }
+    return 0;
+}
+
+// ----------------------------------------------------------------------------
+// Copies a line of HTML to the output as-is.  With flush, the lines held in
+// the output queue are written first.
+//
+// Return Values:
+// int        : 0 = no worries, -1 = memory allocation failure.
+//
+int LineBuilder::AddHtml (const char* pText, bool flush)
+{
+    if (flush)
+    {
+        pOutputQueue = OutputToOutFile (
+                pOutFile,
+                pOutputQueue,
+                pIMode,
+                FuncVar,
+                userS,
+                0,
+                history,
+                pendingBlank);
+        if (pOutputQueue == NULL)
+            return -1;
+    }
+    fputs (pText, pOutFile);
+    fputc (LF, pOutFile);
+    return 0;
+}
+
+// ----------------------------------------------------------------------------
+// Writes the lines still held in the output queue, at the end of the input.
+//
+// Return Values:
+// int        : 0 = no worries, -1 = memory allocation failure.
+//
+int LineBuilder::Finish (void)
+{
+    pOutputQueue = OutputToOutFile (
+            pOutFile,
+            pOutputQueue,
+            pIMode,
+            FuncVar,
+            userS,
+            0,
+            history,
+            pendingBlank);
+    return (pOutputQueue != NULL) ? 0 : -1;
+}
+
 // ----------------------------------------------------------------------------
 // Function is used to bundle all of the input, and output line processing
 // functions together to create a final output file.
@@ -3312,50 +3997,20 @@ static unsigned long int GetStartEndTime (int mode)
 //               0 = no worries.
 //              -1 = memory allocation failure, or line construction failure
 //
-static int ProcessFile (FILE* pInFile, FILE* pOutFile, const Config& userS)
+int ProcessFile (FILE* pInFile, FILE* pOutFile, const Config& userS)
 {
-    const    char* errorMsg = "\n\n#### ERROR ! Memory Allocation Failed\n";
     const    unsigned long lineStep  = 10;     // line number update period (show every 10 lines)
 
     unsigned long int   lineNo       = 0;
-    int                 EndOfFile    = 0;      // Var used by readline() to show eof has been reached
-    char*               pData        = 0;
-
-    int                 pendingBlank = 0;      // var used to control blank lines
-    int                 indentStack  = 0;      // var used for brace spacing
-    int                 indentStack2 = 0;      // save/restore "indentStack" for preprocessor lines
-
-    QueueList*          pOutputQueue = new QueueList();
-    StackList*          pIMode       = new StackList();
-    QueueList*          pInputQueue  = new QueueList();
-
-    int                 FuncVar      = 0;      // variable used in processing function spacing !
-    CharState           curState     = Blank;
-    char*               lineState    = NULL;
-    Boolean             codeOnLine   = False;
-    bool                indentPreP   = False;
-    bool                pendingElse  = False;
-    int                 prepStack    = 0;
-    int                 bracesLevel  = 0;
-    int                 preproLevel  = 0;
-    int                 in_prepro    = 0;
-    HangStruct          hang_state;
-    HtmlStruct          html_state;
-    SqlStruct           sql_state;
-    size_t              beforeSize;
-    bool                beforeSlash  = False;
-    bool                afterSlash;
+    LineDecoder         decoder (pInFile, userS);
+    LineBuilder         builder (pOutFile, userS);
+    QueueList           inputQueue;
+    LineKind            kind;
+    int                 errorCode    = 0;
 
     // Check memory allocated !
-    if (((pOutputQueue == NULL) || (pIMode == NULL)) || (pInputQueue == NULL))
-    {
-           delete pOutputQueue;
-           delete pInputQueue;
-           delete pIMode;
-
-        warning ("%s", errorMsg);
-        return -1;
-    }
+    if (!builder.Ready())
+        return ReportProcessError (-1, lineNo);
 
     if (userS.output != False)
     {
@@ -3365,22 +4020,12 @@ static int ProcessFile (FILE* pInFile, FILE* pOutFile, const Config& userS)
 
     GetStartEndTime (1);    // lets time the operation !
 
-    while (! EndOfFile)
+    while (errorCode == 0 && (kind = decoder.Next (&inputQueue)) != lkEnd)
     {
-        if (pData != 0)
-            delete[] pData;
-
-        pData = ReadLine (pInFile, EndOfFile);
-
-        if (lineState != 0)
+        // the lines of an HTML region after the first are not shown
+        if (kind != lkHtml && decoder.lineNo != lineNo)
         {
-            delete[] lineState;
-            lineState = NULL;
-        }
-
-        if (pData != NULL)
-        {
-            lineNo++;
+            lineNo = decoder.lineNo;
             if ( (lineNo % lineStep == 0) && (userS.output != False) )
             {
                 if (lineNo > 0)
@@ -3388,178 +4033,288 @@ static int ProcessFile (FILE* pInFile, FILE* pOutFile, const Config& userS)
 
                 printf ("%lu ", lineNo);
             }
+        }
 
-            if (html_state.Active(pData))
-            {
-                if (EndOfFile)
-                    break;
-                // flush queue ...
-                pOutputQueue = OutputToOutFile (
-                        pOutFile,
-                        pOutputQueue,
-                        pIMode,
-                        FuncVar,
-                        userS,
-                        0,
-                        pendingBlank);
-                fprintf(pOutFile, "%s\n", pData);
-                continue;
-            }
+        switch (kind)
+        {
+            case lkCode:
+                errorCode = builder.AddLine (&inputQueue);
+                break;
+            case lkHtmlFirst:
+            case lkHtml:
+                errorCode = builder.AddHtml (decoder.pText, kind == lkHtmlFirst);
+                break;
+            case lkError:
+                errorCode = -1;
+                break;
+            default:
+                break;
+        }
+    }// while data
 
-            ExpandTabs (pData,
-                userS.tabSpaceSize,
-                userS.deleteHighChars,
-                userS.quoteChars,
-                curState, lineState, codeOnLine);
-            if (pData == NULL)
-            {
-                warning ("%s", errorMsg);
-                delete pIMode;
-                delete pInputQueue;
-                delete pOutputQueue;
-                return -1;
-            }
+    if (errorCode != 0)
+    {
+        DecodeLineCleanUp (&inputQueue);
+        return ReportProcessError (errorCode, decoder.lineNo);
+    }
 
-            afterSlash = beforeSlash;
-            beforeSlash = isContinuation(beforeSize, pData, lineState);
+    // flush queue ...
+    if ((errorCode = builder.Finish ()) != 0)
+        return ReportProcessError (errorCode, decoder.lineNo);
 
-            if (DecodeLine (afterSlash, 0, pData, lineState, pInputQueue) == 0) // if there are input items to process
-            {
-                int old_prepro = in_prepro;
-                bool restoreit = False;
+    // output final line position
+    lineNo = decoder.lineNo;
+    if (userS.output != False)
+    {
+        if ((lineNo > 0) && (lineNo > lineStep))
+           backSpaceIt (lineNo - (lineNo % lineStep)); // reposition cursor
 
-                if ((in_prepro = beginningPrePro(pInputQueue, in_prepro)) != 0)
-                {
-                    if (in_prepro == 1)
-                    {
-                        TRACE(("save indentStack: %d (%d)\n", in_prepro, indentStack));
-                        indentStack2 = indentStack;
-                    }
-                    else if (in_prepro == 2)
-                    {
-                        TRACE(("increase indentStack\n"));
-                        indentStack += userS.tabSpaceSize;
-                    }
-                }
-                else if (old_prepro)
-                {
-                    restoreit = True;
-                    if (old_prepro == 1)
-                        indentStack += userS.tabSpaceSize;
-                }
+        printf ("%lu ", lineNo);
+    }
 
-                int errorCode = ConstructLine (
-                        indentPreP,
-                        prepStack,
-                        bracesLevel,
-                        preproLevel,
-                        indentStack,
-                        pendingElse,
-                        hang_state,
-                        sql_state,
-                        pInputQueue,
-                        pOutputQueue,
-                        userS);
-
-                switch (errorCode)
-                {
-                    case (0)  : break;
-                    case (-1) :
-                    {
-                        warning ("%s", errorMsg);
-                        delete pIMode;
-                        delete pInputQueue;
-                        delete pOutputQueue;
-                        return errorCode;
-                    }
+    if (userS.output != False)
+    {
+        unsigned long int t = GetStartEndTime (2);
+        int    hours = (t / 60) / 60,
+               mins  = (t / 60),
+               secs  = (t % 60);
+        verbose ("(In %d Hours %d Minutes %d Seconds)", hours, mins, secs);
+        verbose ("\nMaximum Lookahead Used    :  %d Lines", builder.maxLookahead);
+    }
 
-                    case (-2): // Construct line failed !
-                    {
-                        // output final line position
-                        warning ("\nLast Line Read %ld", lineNo);
-                        delete pIMode;
-                        delete pInputQueue;
-                        delete pOutputQueue;
-                        return errorCode;
-                    }
+    return 0;
+}
 
-                    default:
-                    {
-                        warning ("\nSomething Weird %d\n", errorCode);
-                        return errorCode;
-                    }
+// ----------------------------------------------------------------------------
+// A whole file, as LineDecoder returned it, for FormatDecoded().  The items
+// of all of the lines are kept in order in one queue, and each line records
+// how many of them it has.  A line of HTML is kept as a single item.
 
-                }
+struct DecodedLine
+{
+    unsigned char kind;         // LineKind: lkCode, lkHtmlFirst or lkHtml
+    int           items;        // number of items in DecodedFile::items
+    unsigned long lineNo;       // input line, for messages
+};
+
+class DecodedFile
+{
+    public:
+        QueueList       items;          // InputStructures, of every line
+        DecodedLine*    pLines;
+        int             lines;
+        int             lineLimit;      // size of pLines
+
+        DecodedFile (void)
+            : items(), pLines(0), lines(0), lineLimit(0)
+        {
+        }
+        ~DecodedFile (void)
+        {
+            while (items.status() > 0)
+                CleanInputStruct (reinterpret_cast<InputStruct*>(items.takeNext()));
+            delete[] pLines;
+        }
+        int AddLine (LineKind kind, int count, unsigned long lineNo);
 
-                pOutputQueue = OutputToOutFile (
-                            pOutFile,
-                            pOutputQueue,
-                            pIMode,
-                            FuncVar,
-                            userS,
-                            restoreit ? 0 : userS.queueBuffer,
-                            pendingBlank );
+        // use defaults here
+        DecodedFile(const DecodedFile&);
+        DecodedFile& operator=(const DecodedFile&);
+};
 
-                if (pOutputQueue == NULL)
-                {
-                    warning ("%s", errorMsg);
-                    delete pIMode;
-                    delete pInputQueue;
-                    return -1; // memory allocation error !
-                }
+// Records a line whose count items have been put into the queue.  Returns -1
+// if memory allocation failed.
+int DecodedFile::AddLine (LineKind kind, int count, unsigned long lineNo)
+{
+    if (lines >= lineLimit)
+    {
+        int limit = (lineLimit != 0) ? (2 * lineLimit) : 256;
+        DecodedLine* pTemp = new DecodedLine[limit];
+        if (pTemp == NULL)
+            return -1;
+        if (lines != 0)
+            memcpy (pTemp, pLines, lines * sizeof(DecodedLine));
+        delete[] pLines;
+        pLines    = pTemp;
+        lineLimit = limit;
+    }
+    pLines[lines].kind      = static_cast<unsigned char>(kind);
+    pLines[lines].items     = count;
+    pLines[lines].lineNo    = lineNo;
+    lines++;
+    return 0;
+}
+
+// ----------------------------------------------------------------------------
+// Function reads and decodes a whole file, for FormatDecoded().
+//
+// Parameters:
+// pInFile    : Pointer to the user's input FILE structure/handle.
+// userS      : User's configuration settings; only those compared by
+//              SameDecoding() are used.
+//
+// Return Values:
+// DecodedFile* : The decoded file, to be freed by FreeDecoded(), or NULL if
+//                memory allocation failed.
+//
+DecodedFile* DecodeFile (FILE* pInFile, const Config& userS)
+{
+    DecodedFile*        pFile        = new DecodedFile();
+    LineDecoder         decoder (pInFile, userS);
+    QueueList           inputQueue;
+    LineKind            kind;
+    int                 errorCode    = 0;
+
+    if (pFile == NULL)
+        return NULL;
 
-                if (restoreit)
+    while (errorCode == 0 && (kind = decoder.Next (&inputQueue)) != lkEnd)
+    {
+        int count = 0;
+
+        switch (kind)
+        {
+            case lkCode:
+                while (inputQueue.status() > 0)
                 {
-                    TRACE(("restore indentStack (%d) to %d\n", indentStack, indentStack2));
-                    if (indentStack != 0)
+                    ANYOBJECT* pItem = inputQueue.takeNext();
+                    if (pFile -> items.putLast (pItem) != 0)
                     {
-                        pIMode -> pop();
+                        CleanInputStruct (reinterpret_cast<InputStruct*>(pItem));
+                        errorCode = -1;
                     }
-                    indentStack = indentStack2;
+                    count++;
                 }
-
+                break;
+            case lkHtmlFirst:
+            case lkHtml:
+            {
+                InputStruct* pItem = new InputStruct(NoType, 0);
+                if (pItem == NULL
+                 || (pItem -> pData = NewString (decoder.pText)) == NULL
+                 || pFile -> items.putLast (pItem) != 0)
+                {
+                    CleanInputStruct (pItem);
+                    errorCode = -1;
+                }
+                count = 1;
+                break;
             }
-        } // if there's data available
+            case lkError:
+                errorCode = -1;
+                break;
+            default:
+                continue;
+        }
+        if (errorCode == 0)
+            errorCode = pFile -> AddLine (kind, count, decoder.lineNo);
+    }
 
-    }// while data
+    if (errorCode != 0)
+    {
+        DecodeLineCleanUp (&inputQueue);
+        delete pFile;
+        ReportProcessError (errorCode, decoder.lineNo);
+        return NULL;
+    }
+    return pFile;
+}
 
-    // flush queue ...
-    pOutputQueue = OutputToOutFile (
-            pOutFile,
-            pOutputQueue,
-            pIMode,
-            FuncVar,
-            userS,
-            0,
-            pendingBlank);
+// ----------------------------------------------------------------------------
+// Function formats a file from DecodeFile(), as ProcessFile() would format it
+// with the same settings.  The decoded file is only read, so several threads
+// may format one DecodedFile at once, each with its own settings.
+//
+// Parameters:
+// pFile      : The decoded file.
+// pOutFile   : Pointer to the user's output FILE structure/handle.
+// userS      : User's configuration settings, which must decode the same way
+//              as those given to DecodeFile() (see SameDecoding).
+//
+// Return Values:
+// int        : As for ProcessFile().
+//
+int FormatDecoded (DecodedFile* pFile, FILE* pOutFile, const Config& userS)
+{
+    LineBuilder         builder (pOutFile, userS);
+    QueueList           inputQueue;
+    int                 next         = 1;      // next item of pFile, from 1
+    int                 errorCode    = 0;
+    int                 n;
 
-    // output final line position
-    if (userS.output != False)
+    if (!builder.Ready())
+        return ReportProcessError (-1, 0);
+
+    for (n = 0; errorCode == 0 && n < pFile -> lines; ++n)
     {
-        if ((lineNo > 0) && (lineNo > lineStep))
-           backSpaceIt (lineNo - (lineNo % lineStep)); // reposition cursor
+        const DecodedLine& line = pFile -> pLines[n];
 
-        printf ("%lu ", lineNo);
-    }
+        if (line.kind != lkCode)
+        {
+            InputStruct* pItem = reinterpret_cast<InputStruct*>(pFile -> items.peek (next++));
+            errorCode = builder.AddHtml (pItem -> pData, line.kind == lkHtmlFirst);
+            continue;
+        }
 
-    delete pIMode;
-    delete pOutputQueue;
-    delete pInputQueue;
-    delete[] pData;
-    delete[] lineState;
+        // ConstructLine() takes the items it is given, so give it copies
+        for (int i = 0; errorCode == 0 && i < line.items; ++i)
+        {
+            InputStruct* pItem = reinterpret_cast<InputStruct*>(pFile -> items.peek (next++));
+            InputStruct* pCopy = new InputStruct(pItem -> dataType, pItem -> offset);
 
-    if (userS.output != False)
-    {
-        unsigned long int t = GetStartEndTime (2);
-        int    hours = (t / 60) / 60,
-               mins  = (t / 60),
-               secs  = (t % 60);
-        verbose ("(In %d Hours %d Minutes %d Seconds)", hours, mins, secs);
+            if (pCopy == NULL)
+            {
+                errorCode = -1;
+                break;
+            }
+            pCopy -> comWcode = pItem -> comWcode;
+            if (pItem -> pState != NULL)
+                pCopy -> pData = NewFragment (pItem -> pData, pItem -> pState, pCopy -> pState);
+            else
+                pCopy -> pData = NewString (pItem -> pData);
+
+            if (pCopy -> pData == NULL || inputQueue.putLast (pCopy) != 0)
+            {
+                CleanInputStruct (pCopy);
+                errorCode = -1;
+            }
+        }
+
+        if (errorCode == 0)
+            errorCode = builder.AddLine (&inputQueue);
+        if (errorCode != 0)
+            DecodeLineCleanUp (&inputQueue);
     }
 
+    if (errorCode != 0)
+        return ReportProcessError (errorCode, pFile -> pLines[n - 1].lineNo);
+    if ((errorCode = builder.Finish ()) != 0)
+        return ReportProcessError (errorCode, 0);
     return 0;
 }
 
+// ----------------------------------------------------------------------------
+// Frees a file from DecodeFile().
+void FreeDecoded (DecodedFile* pFile)
+{
+    delete pFile;
+}
+
+// ----------------------------------------------------------------------------
+// Returns true if a file decoded with one set of settings may be formatted by
+// FormatDecoded() with the other:  ExpandTabs() uses these, and DecodeLine()
+// uses none.
+bool SameDecoding (const Config& one, const Config& two)
+{
+    return one.tabSpaceSize    == two.tabSpaceSize
+        && one.deleteHighChars == two.deleteHighChars
+        && one.quoteChars      == two.quoteChars;
+}
+
+// The remainder is the command-line program.  Define BCPP_NO_MAIN to link the
+// formatter into another program, e.g., bcpptest.
+#ifndef BCPP_NO_MAIN
+
 // ----------------------------------------------------------------------------
 // locates programs configuration file via the PATH command.
 // Should work for MS-DOS, and Unix environments. Amiga dos
@@ -3677,48 +4432,24 @@ static void FindConfigFile (const char* pCfgName, FILE*& pCfgFile)
 }
 
 // ----------------------------------------------------------------------------
-// Front-end to the program, it reads in the configuration file, checks if there
-// were any errors, and starts processing of the files.
+// Reads the configuration file and the command line, once, into a compiled
+// Config that RunFile() may then share across any number of files.
 //
 // Parameters:
 // argc       : command line parameter count
 // argv[]     : array of pointers to command line parameters
+// settings   : receives the compiled settings
+// pInFile    : receives the input file name given on the command line
+// pOutFile   : receives the output file name given on the command line
 //
 // Return Values:
-// int        : A non zero value indicates processing problem.
+// int        : A non zero value indicates a problem with the parameters.
 //
-static int LoadnRun (int argc, char* argv[])
+static int LoadSettings (int argc, char* argv[], Config& settings, char*& pInFile, char*& pOutFile)
 {
-    const char* pNoFile    = "Couldn't Open, or Create File";
-    bool  renamed          = False;
     char* pConfig          = NULL;
-    char* pInFile          = NULL;
-    char* pOutFile         = NULL;
-    FILE* pInputFile       = NULL;
-    FILE* pOutputFile      = NULL;
-    FILE* pConfigFile      = NULL;
-
-    int   errorNum         = 0;
-    int   errorCode        = 0;
 
-    Config settings        = {2,      // numOfLineFunc
-                              4,      // tabSpaceSize
-                              False,  // useTabs
-                              50,     // posOfCommentsWC
-                              0,      // posOfCommentsNC
-                              False,  // keepCommentsWC
-                              False,  // leaveCommentsNC
-                              False,  // quoteChars
-                              3,      // deleteHighChars
-                              True,   // topBraceLoc
-                              True,   // braceLoc
-                              True,   // output
-                              10,     // queueBuffer
-                              False,  // backUp
-                              False,  // indentPreP
-                              False,  // indent_sql
-                              False,  // braceIndent
-                              False}; // braceIndent2
+    DefaultConfig (settings);
 
 /* ************************************************************************************
     // set defaults
@@ -3734,7 +4465,7 @@ static int LoadnRun (int argc, char* argv[])
     settings.topBraceLoc      = True; // Start top-level open braces on new line
     settings.braceLoc         = True; // Start open braces on new line
     settings.output           = True; // Set this true for normal program output
-    settings.queueBuffer      = 10;   // Set the number if lines to store in memory at a time !
+    settings.queueBuffer      = 100;  // Set the most lines to store in memory at a time !
     settings.backUp           = False;// backup the original file, have output file become input file name !
 ************************************************************************************ */
 
@@ -3747,8 +4478,10 @@ static int LoadnRun (int argc, char* argv[])
 #if defined(MORGAN) && (MORGAN == 1)
     // Ignore the bcpp configuration file; we've set all of the parameters
     // that we care about
-    pConfigFile = NULL;
 #else
+    FILE* pConfigFile      = NULL;
+    int   errorNum         = 0;
+
     // *********************************************************************
     // Find default path and default configuration file name
     if (pConfig == NULL)
@@ -3766,13 +4499,10 @@ static int LoadnRun (int argc, char* argv[])
         // LOAD CONFIG FILE !
         errorNum = SetConfig (pConfigFile, settings);
 
-        // If output is via stdout, then turn out program output if it's
-        // set within config file !
-        if (pOutputFile == stdout)
-           settings.output = False;
-
         if (settings.output != False)
            warning ("\n%d Error(s) In Config File.\n\n", errorNum);
+
+        fclose (pConfigFile);
     }
 #endif
 
@@ -3786,7 +4516,34 @@ static int LoadnRun (int argc, char* argv[])
     if (ProcessCommandLine (argc, argv, settings, pInFile, pOutFile, pConfig) != 0)
        return -1; // problems
 
-    // *********************************************************************
+    // if using standard out, don't corrupt output
+    if (pOutFile == NULL && (settings.backUp == False || pInFile == NULL))
+        settings.output = False;
+
+    CompileConfig (settings);
+    return 0;
+}
+
+// ----------------------------------------------------------------------------
+// Formats one file with settings from LoadSettings(), which are not changed.
+//
+// Parameters:
+// pInFile    : input file name, NULL for stdin
+// pOutFile   : output file name, NULL for stdout
+// settings   : compiled settings
+//
+// Return Values:
+// int        : A non zero value indicates processing problem.
+//
+static int RunFile (char* pInFile, char* pOutFile, const Config& settings)
+{
+    const char* pNoFile    = "Couldn't Open, or Create File";
+    bool  renamed          = False;
+    FILE* pInputFile       = NULL;
+    FILE* pOutputFile      = NULL;
+
+    int   errorNum         = 0;
+    int   errorCode        = 0;
 
     // backup original filename!
     if ( ((settings.backUp != False) && (pInFile != NULL)) &&
@@ -3805,10 +4562,7 @@ static int LoadnRun (int argc, char* argv[])
         pInputFile = fopen(pInFile, "r");
 
     if (pOutFile == NULL)
-    {
-        pOutputFile     = stdout;
-        settings.output = False; // if using standard out, don't corrupt output
-    }
+        pOutputFile = stdout;
     else
         pOutputFile = fopen(pOutFile, "wb");
 
@@ -3828,12 +4582,12 @@ static int LoadnRun (int argc, char* argv[])
     if ((settings.output != False) && (errorCode == 0))
         errorNum = ShowConfig(settings);
 
-    if (pConfigFile != NULL)
-       fclose (pConfigFile);
-
     // #### Lets do some code crunching !
     if ((errorNum == 0) && (errorCode == 0))
+    {
+        traceStart (pInFile);
         errorCode = ProcessFile (pInputFile, pOutputFile, settings);
+    }
 
     if (settings.output != False)
         verbose ("\nCleaning Up Dinner ... ");
@@ -3856,10 +4610,44 @@ static int LoadnRun (int argc, char* argv[])
     return errorCode;
 }
 
+// ----------------------------------------------------------------------------
+// Front-end to the program, it reads in the configuration file, checks if there
+// were any errors, and starts processing of the files.
+//
+// Parameters:
+// argc       : command line parameter count
+// argv[]     : array of pointers to command line parameters
+//
+// Return Values:
+// int        : A non zero value indicates processing problem.
+//
+#if !defined(MORGAN) || (MORGAN != 1)
+static int LoadnRun (int argc, char* argv[])
+{
+    Config settings;
+    char*  pInFile  = NULL;
+    char*  pOutFile = NULL;
+
+    if (LoadSettings (argc, argv, settings, pInFile, pOutFile) != 0)
+       return -1; // problems
+
+    return RunFile (pInFile, pOutFile, settings);
+}
+#endif
+
 // @@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@
 // @@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@
 int main (int argc, char* argv[])
 {
+    // If BCPP_TRACE names a file, keep a binary trace and write it there if
+    // bcpp crashes; bcpptrace decodes it.
+    const char* pTrace = getenv ("BCPP_TRACE");
+    if (pTrace != NULL && *pTrace != NULLC)
+    {
+        traceEnable (true);
+        traceCrashFile (pTrace);
+    }
+
 #if defined(MORGAN) && (MORGAN == 1)
     
     if (argc == 1) {
@@ -3870,6 +4658,22 @@ int main (int argc, char* argv[])
         return -1;
     }
 
+    // Every file is formatted with the same settings, so parse them once:
+    // -fi backup -ylcnc -ya -bcl -no -s -fo original
+    char ylcnc[] = "-ylcnc";
+    char ya[]    = "-ya";
+    char bcl[]   = "-bcl";
+    char no[]    = "-no";
+    char spaces[] = "-s";
+    char* myargs[] = {argv[0], ylcnc, ya, bcl, no, spaces};
+
+    Config settings;
+    char*  pInFile  = NULL;
+    char*  pOutFile = NULL;
+
+    if (LoadSettings (6, myargs, settings, pInFile, pOutFile) != 0)
+        return -1;
+
     for (int i = 1; i < argc; ++i) {
         // Append ".bak" to the filename (do this C-style for ease of porting)
         char* originalfilename = argv[i];
@@ -3885,35 +4689,10 @@ int main (int argc, char* argv[])
             copyfile_state_free(s);
         }
         
-        // Substitute the argument list (quick and dirty memory allocation)
-        char* buf = (char*)malloc(1024);
-        char* fi = buf + 10; 
-        char* qb = fi + 10;
-        char* _10 = qb + 10;
-        char* ylcnc = _10 + 10;
-        char* ya = ylcnc + 10;
-        char* bcl = ya + 10;
-        char* no = bcl + 10;
-        char* s  = no + 10;
-        char* fo = s + 10;
-        strcpy(fi,    "-fi");
-        strcpy(qb,    "-qb");
-        strcpy(_10,   "10");
-        strcpy(ylcnc, "-ylcnc");
-        strcpy(ya,    "-ya");
-        strcpy(bcl,   "-bcl");
-        strcpy(no,    "-no");
-        strcpy(s,     "-s");
-        strcpy(fo,    "-fo");
-        
-        // The args have to be mutable for LoadnRun
-        char* myargs[] = {argv[0], fi, backupfilename, qb, _10, ylcnc, ya, bcl, no, s, fo, originalfilename};
-        LoadnRun(12, myargs);
+        RunFile(backupfilename, originalfilename, settings);
         
         printf("%s\n", originalfilename);
         
-        free(buf);
-        buf = NULL;
         free(backupfilename);
         backupfilename = NULL;
     }
@@ -3923,4 +4702,6 @@ int main (int argc, char* argv[])
     return LoadnRun (argc, argv);
 #endif
 }
+
+#endif // BCPP_NO_MAIN
 // The End :-).
@@ -121,7 +121,8 @@ class InputStruct : public ANYOBJECT
 
         int offset;           // offset within original line's text
         char* pData;          // pointer to queue data !
-        char* pState;         // pointer to corresponding parse-state
+        char* pState;         // pointer to corresponding parse-state,
+                              // allocated with pData (see NewFragment)
 
         inline InputStruct (DataTypes theType, int theOffset)
             : MY_DEFAULT
@@ -153,37 +154,41 @@ extern int   totalTokens;            // token count, for debugging
 #define DBG_DEFAULT
 #endif
 
+// Each of pCode and pBrace is allocated together with its state-flags (see
+// NewFragment), so only the text is deleted.  The pointers are grouped ahead
+// of the counts, to avoid padding.
+
 #define MY_DEFAULT \
+           pCode(NULL), \
+           pCFlag(NULL), \
+           pBrace(NULL), \
+           pBFlag(NULL), \
+           pComment(NULL), \
            pType(ELine), \
            offset(0), \
            bracesLevel(0), \
            preproLevel(0), \
            indentSpace(0), \
            indentHangs(0), \
-           splitElseIf(False), \
-           pCode(NULL), \
-           pCFlag(NULL), \
-           pBrace(NULL), \
-           pBFlag(NULL), \
            filler(0), \
-           pComment(NULL) DBG_DEFAULT
+           splitElseIf(False) DBG_DEFAULT
 
 class OutputStruct : public ANYOBJECT
 {
     public:
+        char* pCode;
+        char* pCFlag;        // state-flags for pCode, in the same block
+        char* pBrace;        // "}" or "{", with possible code-fragment
+        char* pBFlag;        // state-flags for pBrace, in the same block
+        char* pComment;
         DataTypes pType;
         int   offset;        // offset within original line's text
         int   bracesLevel;   // curly-brace level at beginning of line
         int   preproLevel;   // curly-brace level for preprocessor lines
         int   indentSpace;   // num of spaces
         int   indentHangs;   // num of indents for continuation
-        bool  splitElseIf;   // special case for aligning else/if
-        char* pCode;
-        char* pCFlag;        // state-flags for pCode
-        char* pBrace;        // "}" or "{", with possible code-fragment
-        char* pBFlag;        // state-flags for pBrace
         int   filler;        // num of spaces
-        char* pComment;
+        bool  splitElseIf;   // special case for aligning else/if
 #if defined(DEBUG) || defined(DEBUG2)
         int   thisToken;     // current token number
 #endif
@@ -220,9 +225,7 @@ class OutputStruct : public ANYOBJECT
         inline ~OutputStruct (void)
         {
             delete[] pCode;
-            delete[] pCFlag;
             delete[] pBrace;
-            delete[] pBFlag;
             delete[] pComment;
         }
 };
@@ -275,21 +278,31 @@ class HangStruct : public ANYOBJECT
 // ----------------------------------------------------------------------------
 class HtmlStruct : public ANYOBJECT
 {
-        int state;
+        int   state;
+        char* pBuffer;          // line-buffer for NextHtml, reused
+        int   bufferSize;
     public:
         HtmlStruct(void)
-            : state(0)
+            : state(0), pBuffer(0), bufferSize(0)
+        {
+        }
+        ~HtmlStruct(void)
         {
+            delete[] pBuffer;
         }
         bool Active(const char *pLineData);
+        const char *NextHtml(FILE *pInFile, int& EndOfFile);
+
+        // use defaults here
+        HtmlStruct(const HtmlStruct&);
+        HtmlStruct& operator=(const HtmlStruct&);
 };
 
 // ----------------------------------------------------------------------------
 
 #define MY_DEFAULT \
         state(NotSQL), \
-        level(0), \
-        matched()
+        node(0)
 
 enum SqlState {
     NotSQL = 0,
@@ -301,14 +314,12 @@ enum SqlState {
 class SqlStruct : public ANYOBJECT
 {
         SqlState state;
-        int level;
-        char matched[80];
+        int node;               // position in keyword-automaton, see execsql.cpp
 
     public:
         SqlStruct(void)
             : MY_DEFAULT
         {
-            matched[0] = 0;
         }
         void IndentSQL(OutputStruct *pOut);
 
@@ -354,9 +365,85 @@ class IndentStruct : public ANYOBJECT
 
 #undef MY_DEFAULT
 
+//-----------------------------------------------------------------------------
+// Binary trace.  When enabled (traceEnable), the TRACE_INPUT, TRACE_INDENT and
+// TRACE_OUTPUT points record fixed-size events in a ring buffer belonging to
+// the calling thread, keeping the most recent TraceRingSize of them.  When it
+// is not enabled, each point costs only a test of pTraceRing.  The ring is
+// written by traceDump (or by the handler from traceCrashFile), and decoded
+// to text by bcpptrace.
+
+#if defined(__GNUC__)
+#define TRACE_TLS __thread
+#elif defined(_MSC_VER)
+#define TRACE_TLS __declspec(thread)
+#else
+#define TRACE_TLS /* single-threaded */
+#endif
+
+enum TracePhase { trInput = 0, trIndent = 1, trOutput = 2 };
+
+struct TraceEvent
+{
+    unsigned char  phase;     // TracePhase
+    unsigned char  kind;      // DataTypes, or IndentAttr for trIndent
+    unsigned short site;      // source line of the trace-point
+    int            line;      // input line being read when recorded
+    short          value[4];  // depends on phase, see traceDecode()
+};
+
+const int TraceRingSize = 4096;   // events kept, must be a power of 2
+
+struct TraceRing
+{
+    char           magic[8];  // "BCPPTR1": "BCPPTR" and format-version 1
+    unsigned int   size;      // TraceRingSize, when written
+    unsigned int   next;      // count of events recorded
+    int            line;      // input line being read
+    char           name[64];  // file being formatted, may be truncated
+    TraceEvent     event[TraceRingSize];
+};
+
+extern TRACE_TLS TraceRing* pTraceRing;
+
 //-----------------------------------------------------------------------------
 // debug.cpp
 extern void trace (const char *format, ...);
+extern void traceEnable (bool enable);
+extern void traceStart (const char *name);
+extern void traceRecord (int phase, int kind, int site, int v0, int v1, int v2, int v3);
+extern bool traceDump (const char *filename);
+extern void traceCrashFile (const char *filename);
+extern int  traceDecode (FILE *pInFile, FILE *pOutFile);
+
+inline void traceLine (int line)
+{
+    if (pTraceRing != 0)
+        pTraceRing->line = line;
+}
+
+inline void traceInputEvent (int site, const InputStruct *pIn)
+{
+    if (pTraceRing != 0 && pIn != 0)
+        traceRecord (trInput, pIn->dataType, site,
+                     pIn->offset, pIn->comWcode != False, 0, 0);
+}
+
+inline void traceIndentEvent (int site, const IndentStruct *pIndent)
+{
+    if (pTraceRing != 0 && pIndent != 0)
+        traceRecord (trIndent, pIndent->attrib, site,
+                     pIndent->pos, pIndent->singleIndentLen, 0, 0);
+}
+
+inline void traceOutputEvent (int site, const OutputStruct *pOut)
+{
+    if (pTraceRing != 0 && pOut != 0)
+        traceRecord (trOutput, pOut->pType, site,
+                     pOut->indentSpace, pOut->indentHangs,
+                     pOut->filler, pOut->bracesLevel);
+}
+
 #ifdef DEBUG
 extern void traceInput(const char *file, int line, InputStruct *pIn);
 extern void traceIndent(const char *file, int line, IndentStruct *pIndent);
@@ -365,9 +452,9 @@ extern void traceOutput(const char *file, int line, OutputStruct *pOut);
 #define TRACE_INDENT(pOut) traceIndent(__FILE__, __LINE__, pOut);
 #define TRACE_OUTPUT(pOut) traceOutput(__FILE__, __LINE__, pOut);
 #else
-#define TRACE_INPUT(pOut)  /* nothing */
-#define TRACE_INDENT(pOut) /* nothing */
-#define TRACE_OUTPUT(pOut) /* nothing */
+#define TRACE_INPUT(pOut)  traceInputEvent(__LINE__, pOut);
+#define TRACE_INDENT(pOut) traceIndentEvent(__LINE__, pOut);
+#define TRACE_OUTPUT(pOut) traceOutputEvent(__LINE__, pOut);
 #endif
 
 inline bool emptyString(const char *s)
@@ -376,6 +463,17 @@ inline bool emptyString(const char *s)
 }
 
 //-----------------------------------------------------------------------------
+// bcpp.cpp
+extern int ProcessFile (FILE* pInFile, FILE* pOutFile, const Config& userS);
+
+// A file is decoded once by DecodeFile(), and may then be formatted with any
+// settings for which SameDecoding() is true, by any number of threads at once.
+class DecodedFile;
+extern DecodedFile* DecodeFile (FILE* pInFile, const Config& userS);
+extern int FormatDecoded (DecodedFile* pFile, FILE* pOutFile, const Config& userS);
+extern void FreeDecoded (DecodedFile* pFile);
+extern bool SameDecoding (const Config& one, const Config& two);
+
 // backup.cpp
 extern int BackupFile (char*& oldFilename, char*& newFilename);
 extern void RestoreIfUnchanged(char *oldFilename, char *newFilename);
@@ -394,6 +492,7 @@ extern bool ContinuedQuote(OutputStruct *pOut);
 extern bool isName(char c);
 extern bool CompareKeyword(const char *tst, const char *ref);
 extern char *NewString (const char *src);
+extern char *NewFragment (const char *src, const char *state, char *&dstState);
 extern char *NewSubstring (const char *src, size_t len);
 extern const char *SkipBlanks(const char *s);
 
@@ -403,7 +502,7 @@ extern void ExpandTabs (char* &pString,
     int deleteChars,
     Boolean quoteChars,
     CharState &curState, char * &lineState, Boolean &codeOnLine);
-extern char* TabSpacing (int mode, int col, int len, int spaceIndent);
+extern void WriteSpacing (FILE* pOutFile, const Config& userS, int col, int len);
 
 // verbose.cpp
 extern bool prompt (const char *format, ...);
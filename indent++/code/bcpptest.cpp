@@ -0,0 +1,1461 @@
+// $Id: bcpptest.cpp$
+// bcpptest.cpp
+//
+// Regression and throughput driver for bcpp.  This links the formatter (built
+// with BCPP_NO_MAIN) and runs each input/output pair in-process, rather than
+// forking bcpp and diff for each file as run-test does.
+//
+// Usage: bcpptest [options] [input-dir [output-dir]]
+//
+// Each file in input-dir is formatted and compared byte-for-byte with the file
+// of the same name in output-dir.  A subdirectory of input-dir which contains
+// a ".bcpp" file is a test-configuration, as in run-test:  every file in
+// input-dir is formatted again with that configuration, and compared with the
+// corresponding file in output-dir/subdirectory.
+//
+// Results are written one per line, tab-separated, in name order so that the
+// reports from two runs can be compared with diff.
+//
+// With "-scale", it instead formats pathological inputs (very long lines,
+// runs of braces) at doubling sizes, each in a child process, and fails if
+// the time or memory taken grows faster than the input.
+//
+// With "-style" (once for each configuration file), it instead reports the
+// lines that each configuration would remove and add in the files under
+// input-dir, to compare candidate styles.  Each file is read and decoded once,
+// and formatted with every configuration at the same time, in threads.
+
+#include "bcpp.h"
+
+#include <stdlib.h>
+#include <time.h>
+#include <math.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+// ----------------------------------------------------------------------------
+// Sizes of the generated inputs, scaled by the "-syn" option.
+const int SynNesting   = 50;      // levels of nested blocks
+const int SynLongLine  = 10000;   // characters in a single statement
+const int SynTabs      = 1000;    // tab-indented lines
+const int SynComment   = 2000;    // lines in one C comment
+const int SynStatement = 1000;    // statements in a flat function
+const int SynSqlBlock  = 200;     // embedded SQL blocks, among C code
+
+// Sizes of the "-scale" inputs, and the growth which fails.
+const long   ScaleUnit     = 16384; // bytes, at the smallest size
+const double ScaleMinTime  = 0.1;   // seconds, repeating faster runs
+const long   ScaleMinRSS   = 256;   // KB, below which growth is not judged
+const double ScaleExponent = 1.2;   // fail if cost grows as size^this
+const int    ScaleSteps    = 16;    // most sizes measured, doubling
+
+// Limits for "-style".
+const int    StyleLimit    = 16;        // configurations, each with a thread
+const long   StyleDiffCost = 20000000;  // steps, before counting lines unordered
+
+struct TestTotals
+{
+    int    files;
+    int    failed;
+    long   lines;
+    long   bytes;
+    double seconds;
+};
+
+struct TestOptions
+{
+    int    repeat;          // number of times each file is formatted
+    bool   timing;          // false to omit (unstable) timing columns
+    const char* pTraceDir;  // if set, where to write traces of failures
+};
+
+// ----------------------------------------------------------------------------
+// Reads the whole of a file into a newly allocated, null-terminated buffer.
+// Returns NULL if the file cannot be read.
+static char* ReadWholeFile (const char* pName, long& size)
+{
+    FILE* fp = fopen (pName, "rb");
+    char* result = NULL;
+
+    size = 0;
+    if (fp != NULL)
+    {
+        if (fseek (fp, 0L, SEEK_END) == 0
+         && (size = ftell (fp)) >= 0
+         && fseek (fp, 0L, SEEK_SET) == 0)
+        {
+            result = new char[size + 1];
+            if (fread (result, 1, size, fp) != static_cast<size_t>(size))
+            {
+                delete[] result;
+                result = NULL;
+            }
+            else
+            {
+                result[size] = NULLC;
+            }
+        }
+        fclose (fp);
+    }
+    return result;
+}
+
+static bool WriteWholeFile (const char* pName, const char* pData, long size)
+{
+    FILE* fp = fopen (pName, "wb");
+    bool result = false;
+
+    if (fp != NULL)
+    {
+        result = (fwrite (pData, 1, size, fp) == static_cast<size_t>(size));
+        if (fclose (fp) != 0)
+            result = false;
+    }
+    return result;
+}
+
+static long CountLines (const char* pData, long size)
+{
+    long result = 0;
+
+    for (long n = 0; n < size; ++n)
+    {
+        if (pData[n] == LF)
+            ++result;
+    }
+    if (size > 0 && pData[size - 1] != LF)
+        ++result;
+    return result;
+}
+
+// Returns the line number (from 1) of the first difference, or zero if both
+// buffers are identical.
+static long FirstDifference (const char* pOne, long oneSize, const char* pTwo, long twoSize)
+{
+    long line = 1;
+
+    for (long n = 0; n < oneSize && n < twoSize; ++n)
+    {
+        if (pOne[n] != pTwo[n])
+            return line;
+        if (pOne[n] == LF)
+            ++line;
+    }
+    return (oneSize == twoSize) ? 0 : line;
+}
+
+static bool IsDirectory (const char* pName)
+{
+    struct stat sb;
+    return (stat (pName, &sb) == 0) && S_ISDIR(sb.st_mode);
+}
+
+static bool IsFile (const char* pName)
+{
+    struct stat sb;
+    return (stat (pName, &sb) == 0) && S_ISREG(sb.st_mode);
+}
+
+static char* PathOf (const char* pDir, const char* pLeaf)
+{
+    char* result = new char[strlen (pDir) + strlen (pLeaf) + 2];
+    sprintf (result, "%s/%s", pDir, pLeaf);
+    return result;
+}
+
+static int CompareNames (const void* pOne, const void* pTwo)
+{
+    return strcmp (*static_cast<char* const*>(pOne), *static_cast<char* const*>(pTwo));
+}
+
+// ----------------------------------------------------------------------------
+// Lists the names in a directory, sorted, omitting those which begin with '.'.
+//
+// Parameters:
+// pDir       : Name of the directory to read.
+// wantDirs   : true for subdirectories, false for files.
+// count      : Set to the number of names returned.
+//
+// Return Values:
+// char**     : Array of names, freed by FreeNames().  NULL if the directory
+//              cannot be read.
+//
+static char** ListNames (const char* pDir, bool wantDirs, int& count)
+{
+    DIR* dp = opendir (pDir);
+    char** result = NULL;
+    int limit = 0;
+
+    count = 0;
+    if (dp == NULL)
+        return NULL;
+
+    struct dirent* de;
+    while ((de = readdir (dp)) != NULL)
+    {
+        if (de->d_name[0] == '.')
+            continue;
+
+        char* pPath = PathOf (pDir, de->d_name);
+        bool isDir = IsDirectory (pPath);
+        bool keep = wantDirs ? isDir : (!isDir && IsFile (pPath));
+        delete[] pPath;
+
+        if (!keep)
+            continue;
+
+        if (count + 1 >= limit)
+        {
+            char** grown = new char*[limit = (limit + 16) * 2];
+            for (int n = 0; n < count; ++n)
+                grown[n] = result[n];
+            delete[] result;
+            result = grown;
+        }
+        result[count++] = NewString (de->d_name);
+    }
+    closedir (dp);
+
+    if (result == NULL)
+        result = new char*[1];
+    qsort (result, count, sizeof(char*), CompareNames);
+    return result;
+}
+
+static void FreeNames (char** pNames, int count)
+{
+    if (pNames != NULL)
+    {
+        for (int n = 0; n < count; ++n)
+            delete[] pNames[n];
+        delete[] pNames;
+    }
+}
+
+// ----------------------------------------------------------------------------
+// Loads the configuration used for a group of tests, starting from the same
+// defaults as bcpp.  Returns the number of errors found in the file.
+static int LoadConfig (const char* pName, Config& userS)
+{
+    int result = 0;
+
+    DefaultConfig (userS);
+    if (pName != NULL)
+    {
+        FILE* fp = fopen (pName, "r");
+        if (fp == NULL)
+        {
+            warning ("Couldn't Open Config File: %s\n", pName);
+            result = 1;
+        }
+        else
+        {
+            result = SetConfig (fp, userS);
+            fclose (fp);
+        }
+    }
+    userS.output = False;       // no progress-messages from ProcessFile
+    CompileConfig (userS);
+    return result;
+}
+
+// ----------------------------------------------------------------------------
+// Reads back the whole of a temporary file which has been written, into a newly
+// allocated, null-terminated buffer, and sets its length.  Returns NULL if it
+// cannot be read.
+static char* ReadTempFile (FILE* fp, long& size)
+{
+    char* result = NULL;
+
+    fflush (fp);
+    if ((size = ftell (fp)) >= 0)
+    {
+        result = new char[size + 1];
+        rewind (fp);
+        if (fread (result, 1, size, fp) != static_cast<size_t>(size))
+        {
+            delete[] result;
+            result = NULL;
+        }
+        else
+        {
+            result[size] = NULLC;
+        }
+    }
+    return result;
+}
+
+// ----------------------------------------------------------------------------
+// Formats a buffer in-process.
+//
+// Parameters:
+// pName      : Name of the test, recorded in the trace.
+// pData      : Text to format.
+// size       : Length of pData.
+// userS      : Configuration to format with.
+// options    : "repeat" gives the number of times to format the text.
+// seconds    : Set to the processor time taken by all of the repetitions.
+// resultSize : Set to the length of the result.
+//
+// Return Values:
+// char*      : Newly allocated result of the last repetition, or NULL if
+//              ProcessFile failed.
+//
+static char* FormatBuffer (const char* pName, const char* pData, long size, const Config& userS,
+                           const TestOptions& options, double& seconds, long& resultSize)
+{
+    FILE* pInFile  = tmpfile ();
+    FILE* pOutFile = tmpfile ();
+    char* result   = NULL;
+    int   status   = 0;
+
+    seconds    = 0.0;
+    resultSize = 0;
+
+    if (pInFile == NULL || pOutFile == NULL)
+    {
+        warning ("Cannot create temporary file\n");
+        status = -1;
+    }
+    else if (fwrite (pData, 1, size, pInFile) != static_cast<size_t>(size))
+    {
+        warning ("Cannot write temporary file\n");
+        status = -1;
+    }
+
+    for (int pass = 0; status == 0 && pass < options.repeat; ++pass)
+    {
+        rewind (pInFile);
+        rewind (pOutFile);
+
+        traceStart (pName);
+        clock_t start = clock ();
+        status = ProcessFile (pInFile, pOutFile, userS);
+        fflush (pOutFile);
+        seconds += static_cast<double>(clock () - start) / CLOCKS_PER_SEC;
+
+        resultSize = ftell (pOutFile);
+    }
+
+    if (status == 0)
+        result = ReadTempFile (pOutFile, resultSize);
+
+    if (pInFile != NULL)
+        fclose (pInFile);
+    if (pOutFile != NULL)
+        fclose (pOutFile);
+    return result;
+}
+
+// Formats a file which has been decoded, into a newly allocated buffer.
+// Returns NULL if FormatDecoded failed.
+static char* FormatDecodedBuffer (DecodedFile* pDecoded, const Config& userS, long& resultSize)
+{
+    FILE* pOutFile = tmpfile ();
+    char* result   = NULL;
+
+    resultSize = 0;
+    if (pOutFile == NULL)
+    {
+        warning ("Cannot create temporary file\n");
+    }
+    else
+    {
+        if (FormatDecoded (pDecoded, pOutFile, userS) == 0)
+            result = ReadTempFile (pOutFile, resultSize);
+        fclose (pOutFile);
+    }
+    return result;
+}
+
+
+// Formats a buffer again, through DecodeFile() and FormatDecoded() as the
+// "-style" option does, and returns the line number (from 1) at which the
+// result differs from that of ProcessFile(), or zero if it does not.
+static long DecodedDifference (const char* pData, long size, const Config& userS,
+                               const char* pResult, long resultSize)
+{
+    FILE* pInFile = tmpfile ();
+    long  result  = 1;
+
+    if (pInFile != NULL
+     && fwrite (pData, 1, size, pInFile) == static_cast<size_t>(size))
+    {
+        rewind (pInFile);
+        DecodedFile* pDecoded = DecodeFile (pInFile, userS);
+        if (pDecoded != NULL)
+        {
+            long  decodedSize;
+            char* pDecodedResult = FormatDecodedBuffer (pDecoded, userS, decodedSize);
+            if (pDecodedResult != NULL)
+                result = FirstDifference (pResult, resultSize, pDecodedResult, decodedSize);
+            delete[] pDecodedResult;
+            FreeDecoded (pDecoded);
+        }
+    }
+    if (pInFile != NULL)
+        fclose (pInFile);
+    return result;
+}
+
+// ----------------------------------------------------------------------------
+static void ReportHeader (const TestOptions& options)
+{
+    printf ("# result\tname\tlines\tbytes");
+    if (options.timing)
+        printf ("\tseconds\tlines/s\tMB/s");
+    printf ("\n");
+}
+
+static void ReportLine (const char* pResult, const char* pName,
+                        long lines, long bytes, double seconds,
+                        const TestOptions& options)
+{
+    printf ("%s\t%s\t%ld\t%ld", pResult, pName, lines, bytes);
+    if (options.timing)
+    {
+        // throughput is per repetition
+        double each = (seconds > 0.0) ? (seconds / options.repeat) : 0.0;
+        if (each > 0.0)
+            printf ("\t%.6f\t%.0f\t%.2f", each, lines / each, bytes / each / 1.0e6);
+        else
+            printf ("\t%.6f\t-\t-", each);
+    }
+    printf ("\n");
+    fflush (stdout);
+}
+
+static void AddTotals (TestTotals& totals, long lines, long bytes, double seconds, bool failed)
+{
+    totals.files   += 1;
+    totals.failed  += failed ? 1 : 0;
+    totals.lines   += lines;
+    totals.bytes   += bytes;
+    totals.seconds += seconds;
+}
+
+// ----------------------------------------------------------------------------
+// Writes the trace of a test which failed, as pTraceDir/name.trc (with any
+// '/' in the name replaced), so that it can be read with bcpptrace.
+static void DumpTrace (const char* pName, const TestOptions& options)
+{
+    if (options.pTraceDir == NULL)
+        return;
+
+    char* pLeaf = new char[strlen (pName) + 5];
+    sprintf (pLeaf, "%s.trc", pName);
+    for (char* s = pLeaf; *s != NULLC; ++s)
+    {
+        if (*s == '/')
+            *s = '_';
+    }
+
+    char* pPath = PathOf (options.pTraceDir, pLeaf);
+    if (traceDump (pPath))
+        printf ("#\t%s trace in %s\n", pName, pPath);
+    else
+        warning ("Cannot write trace %s\n", pPath);
+    delete[] pPath;
+    delete[] pLeaf;
+}
+
+// ----------------------------------------------------------------------------
+// Formats one file and compares the result with the expected output.  A
+// missing expected-file is reported, but does not count as a failure, so that
+// a new corpus can be benchmarked before its output has been reviewed.  The
+// result must also be the same when the file is decoded first, as for the
+// "-style" option.
+static void TestOneFile (const char* pInput, const char* pExpect, const char* pName,
+                         const Config& userS, const TestOptions& options, TestTotals& totals)
+{
+    long   size;
+    long   resultSize;
+    long   expectSize;
+    double seconds;
+    char*  pData = ReadWholeFile (pInput, size);
+
+    if (pData == NULL)
+    {
+        ReportLine ("ERROR", pName, 0, 0, 0.0, options);
+        AddTotals (totals, 0, 0, 0.0, true);
+        return;
+    }
+
+    long  lines   = CountLines (pData, size);
+    char* pResult = FormatBuffer (pName, pData, size, userS, options, seconds, resultSize);
+    char* pExpectData = (pExpect != NULL) ? ReadWholeFile (pExpect, expectSize) : NULL;
+    long  decoded = (pResult != NULL) ? DecodedDifference (pData, size, userS, pResult, resultSize) : 0;
+
+    if (pResult == NULL)
+    {
+        ReportLine ("ERROR", pName, lines, size, seconds, options);
+        DumpTrace (pName, options);
+        AddTotals (totals, lines, size, seconds, true);
+    }
+    else
+    {
+        long diff = (pExpectData != NULL)
+                  ? FirstDifference (pExpectData, expectSize, pResult, resultSize)
+                  : 0;
+        ReportLine ((diff || decoded) ? "FAIL" : ((pExpectData != NULL) ? "ok" : "new"),
+                    pName, lines, size, seconds, options);
+        if (diff)
+            printf ("#\t%s differs at line %ld\n", pName, diff);
+        if (decoded)
+            printf ("#\t%s differs when decoded first, at line %ld\n", pName, decoded);
+        if (diff || decoded)
+            DumpTrace (pName, options);
+        AddTotals (totals, lines, size, seconds, diff != 0 || decoded != 0);
+    }
+
+    delete[] pData;
+    delete[] pResult;
+    delete[] pExpectData;
+}
+
+// ----------------------------------------------------------------------------
+// Runs every file in pInDir against pOutDir.  pPrefix (if non-null) is the
+// name of the configuration subdirectory, shown before each file-name.
+static int TestDirectory (const char* pInDir, const char* pOutDir, const char* pPrefix,
+                          const Config& userS, const TestOptions& options, TestTotals& totals)
+{
+    int count;
+    char** pNames = ListNames (pInDir, false, count);
+
+    if (pNames == NULL)
+    {
+        warning ("Cannot read directory %s\n", pInDir);
+        return -1;
+    }
+
+    for (int n = 0; n < count; ++n)
+    {
+        char* pInput  = PathOf (pInDir, pNames[n]);
+        char* pExpect = PathOf (pOutDir, pNames[n]);
+        char* pName   = (pPrefix != NULL) ? PathOf (pPrefix, pNames[n]) : NewString (pNames[n]);
+
+        TestOneFile (pInput, IsFile (pExpect) ? pExpect : NULL, pName, userS, options, totals);
+
+        delete[] pInput;
+        delete[] pExpect;
+        delete[] pName;
+    }
+    FreeNames (pNames, count);
+    return 0;
+}
+
+// ----------------------------------------------------------------------------
+// Synthetic inputs, for measuring how the formatter scales.  Each generator
+// returns a newly allocated buffer, and sets its length.
+
+// Appends to a buffer which grows as needed.
+struct SynBuffer
+{
+    char* pData;
+    long  size;
+    long  limit;
+};
+
+static void SynAppend (SynBuffer& buf, const char* pText, long repeat = 1)
+{
+    long len = strlen (pText);
+
+    while (buf.size + (len * repeat) + 1 > buf.limit)
+    {
+        buf.limit = (buf.limit + 1024) * 2;
+        char* grown = new char[buf.limit];
+        if (buf.size)
+            memcpy (grown, buf.pData, buf.size);
+        delete[] buf.pData;
+        buf.pData = grown;
+    }
+    while (repeat-- > 0)
+    {
+        memcpy (buf.pData + buf.size, pText, len);
+        buf.size += len;
+    }
+    buf.pData[buf.size] = NULLC;
+}
+
+static void SynNestedBlocks (SynBuffer& buf, int scale)
+{
+    int depth = SynNesting * scale;
+
+    SynAppend (buf, "void nested(int x)\n{\n");
+    for (int n = 0; n < depth; ++n)
+    {
+        SynAppend (buf, " ", n);
+        SynAppend (buf, "if (x > 0)\n");
+        SynAppend (buf, " ", n);
+        SynAppend (buf, "{\n");
+        SynAppend (buf, " ", n);
+        SynAppend (buf, "x = x - 1;   // step\n");
+    }
+    for (int n = depth; n-- > 0; )
+    {
+        SynAppend (buf, " ", n);
+        SynAppend (buf, "}\n");
+    }
+    SynAppend (buf, "}\n");
+}
+
+static void SynLongLines (SynBuffer& buf, int scale)
+{
+    for (int n = 0; n < 4; ++n)
+    {
+        SynAppend (buf, "int total = value");
+        SynAppend (buf, " + value", (SynLongLine / 8) * scale);
+        SynAppend (buf, "; /* long */\n");
+    }
+}
+
+static void SynTabbedLines (SynBuffer& buf, int scale)
+{
+    SynAppend (buf, "int tabbed()\n{\n");
+    for (int n = 0; n < SynTabs * scale; ++n)
+    {
+        SynAppend (buf, "\t", 1 + (n % 4));
+        SynAppend (buf, "call(a,\tb,\t\"tab\there\");\t\t// comment\twith\ttabs\n");
+    }
+    SynAppend (buf, "}\n");
+}
+
+static void SynHugeComment (SynBuffer& buf, int scale)
+{
+    SynAppend (buf, "/*\n");
+    for (int n = 0; n < SynComment * scale; ++n)
+        SynAppend (buf, " * A comment line, which should be aligned with its start.\n");
+    SynAppend (buf, " */\nint after_comment;\n");
+}
+
+static void SynFlatFunction (SynBuffer& buf, int scale)
+{
+    SynAppend (buf, "int flat(int a, int b)\n{\n");
+    for (int n = 0; n < SynStatement * scale; ++n)
+    {
+        SynAppend (buf, "    if (a < b)\n");
+        SynAppend (buf, "        a = b;\n");
+        SynAppend (buf, "    else\n");
+        SynAppend (buf, "    {\n");
+        SynAppend (buf, "        b = a;\n");
+        SynAppend (buf, "    }\n");
+    }
+    SynAppend (buf, "    return a;\n}\n");
+}
+
+static void SynEmbeddedSQL (SynBuffer& buf, int scale)
+{
+    SynAppend (buf, "EXEC SQL BEGIN DECLARE SECTION;\n");
+    SynAppend (buf, "int id;\nchar name[32];\n");
+    SynAppend (buf, "EXEC SQL END DECLARE SECTION;\n\n");
+    SynAppend (buf, "int query(int a, int b)\n{\n");
+    for (int n = 0; n < SynSqlBlock * scale; ++n)
+    {
+        SynAppend (buf, "    for (a = 0; a < b; a++)\n");
+        SynAppend (buf, "    {\n");
+        SynAppend (buf, "        total += lookup(a, \"key\");   /* plain C */\n");
+        SynAppend (buf, "    }\n");
+        SynAppend (buf, "    EXEC SQL SELECT name\n");
+        SynAppend (buf, "    INTO :name\n");
+        SynAppend (buf, "    FROM people\n");
+        SynAppend (buf, "    WHERE id = :id;\n");
+        SynAppend (buf, "    EXEC SQL EXECUTE\n");
+        SynAppend (buf, "    BEGIN\n");
+        SynAppend (buf, "    UPDATE people SET seen = 1 WHERE id = :id;\n");
+        SynAppend (buf, "    END;\n");
+        SynAppend (buf, "    END-EXEC;\n");
+    }
+    SynAppend (buf, "    return a;\n}\n");
+}
+
+static const struct
+{
+    const char* name;
+    void (*generate)(SynBuffer&, int);
+    bool sql;                   // format with indent_exec_sql
+}
+SynCorpus[] =
+{
+    { "syn-comment.c",  SynHugeComment,  false },
+    { "syn-flat.c",     SynFlatFunction, false },
+    { "syn-longline.c", SynLongLines,    false },
+    { "syn-nesting.c",  SynNestedBlocks, false },
+    { "syn-sql.pc",     SynEmbeddedSQL,  true  },
+    { "syn-tabs.c",     SynTabbedLines,  false },
+};
+
+// Formats (or with pGenDir, writes) each synthetic input at the given scale.
+static int TestSynthetic (int scale, const char* pGenDir,
+                          const Config& userS, const TestOptions& options, TestTotals& totals)
+{
+    int    result = 0;
+    Config sqlS   = userS;
+
+    sqlS.indent_sql = True;
+    for (size_t n = 0; n < TABLESIZE(SynCorpus); ++n)
+    {
+        SynBuffer buf = { NULL, 0, 0 };
+        SynCorpus[n].generate (buf, scale);
+
+        if (pGenDir != NULL)
+        {
+            char* pPath = PathOf (pGenDir, SynCorpus[n].name);
+            if (!WriteWholeFile (pPath, buf.pData, buf.size))
+            {
+                warning ("Cannot write %s\n", pPath);
+                result = -1;
+            }
+            delete[] pPath;
+        }
+        else
+        {
+            long   resultSize;
+            double seconds;
+            long   lines   = CountLines (buf.pData, buf.size);
+            char*  pResult = FormatBuffer (SynCorpus[n].name, buf.pData, buf.size,
+                                           SynCorpus[n].sql ? sqlS : userS, options, seconds, resultSize);
+
+            ReportLine ((pResult != NULL) ? "bench" : "ERROR", SynCorpus[n].name,
+                        lines, buf.size, seconds, options);
+            AddTotals (totals, lines, buf.size, seconds, pResult == NULL);
+            delete[] pResult;
+        }
+        delete[] buf.pData;
+    }
+    return result;
+}
+
+// ----------------------------------------------------------------------------
+// Pathological inputs, which should take time and memory in proportion to
+// their size.  Each generator makes about "bytes" of input.
+
+static void ScaleMinified (SynBuffer& buf, long bytes)
+{
+    static const char text[] = "if(a){x=a+1;y=f(a,b);}else{z=b;}";
+
+    SynAppend (buf, "function f(a,b){");
+    SynAppend (buf, text, bytes / (sizeof(text) - 1));
+    SynAppend (buf, "}\n");
+}
+
+static void ScaleTabbedLine (SynBuffer& buf, long bytes)
+{
+    SynAppend (buf, "int x = f(a");
+    SynAppend (buf, ",\tb", bytes / 3);
+    SynAppend (buf, ");\t// tabs\there\n");
+}
+
+static void ScaleBraceLine (SynBuffer& buf, long bytes)
+{
+    SynAppend (buf, "{}", bytes / 4);
+    SynAppend (buf, "}", bytes / 2);
+    SynAppend (buf, "\n");
+}
+
+static void ScaleCloseLines (SynBuffer& buf, long bytes)
+{
+    SynAppend (buf, "}\n", bytes / 2);
+}
+
+static void ScaleStatements (SynBuffer& buf, long bytes)
+{
+    SynAppend (buf, "int flat()\n{\n");
+    SynAppend (buf, "a = b; ", bytes / 7);
+    SynAppend (buf, "\n}\n");
+}
+
+static void ScaleContinued (SynBuffer& buf, long bytes)
+{
+    SynAppend (buf, "#define LIST \\\n");
+    SynAppend (buf, "\t{ a, b }, \\\n", bytes / 13);
+    SynAppend (buf, "\t{ 0, 0 }\n");
+}
+
+static const struct
+{
+    const char* name;
+    void (*generate)(SynBuffer&, long);
+}
+ScaleCorpus[] =
+{
+    { "brace-line",     ScaleBraceLine },
+    { "close-lines",    ScaleCloseLines },
+    { "continued",      ScaleContinued },
+    { "minified",       ScaleMinified },
+    { "statements",     ScaleStatements },
+    { "tabbed-line",    ScaleTabbedLine },
+};
+
+// What a child process measured, for one input.
+struct ScaleResult
+{
+    int    status;          // 0 if formatted
+    long   bytes;           // size of the input
+    double seconds;         // per repetition
+    long   maxRSS;          // KB, peak resident
+};
+
+// Formats one input in a child process, so that its peak memory can be
+// measured, and so that a crash is reported rather than ending the suite.
+static ScaleResult ScaleMeasure (size_t which, long bytes, const Config& userS)
+{
+    ScaleResult result = { -1, 0, 0.0, 0 };
+    int fds[2];
+
+    fflush (stdout);
+    if (pipe (fds) != 0)
+        return result;
+
+    pid_t pid = fork ();
+    if (pid == 0)
+    {
+        SynBuffer   buf     = { NULL, 0, 0 };
+        TestOptions options = { 1, true, NULL };
+        const char* pName   = "empty";
+        long        resultSize;
+        struct rusage usage;
+
+        close (fds[0]);
+        if (which < TABLESIZE(ScaleCorpus))
+        {
+            pName = ScaleCorpus[which].name;
+            ScaleCorpus[which].generate (buf, bytes);
+        }
+        else
+            SynAppend (buf, "");
+        result.bytes = buf.size;
+
+        // repeat a fast run, for a measurable time
+        char* pResult = FormatBuffer (pName, buf.pData, buf.size,
+                                      userS, options, result.seconds, resultSize);
+        if (pResult != NULL
+         && result.seconds < ScaleMinTime)
+        {
+            delete[] pResult;
+            options.repeat = static_cast<int>(ScaleMinTime / (result.seconds + 1.0e-4)) + 1;
+            pResult = FormatBuffer (pName, buf.pData, buf.size,
+                                    userS, options, result.seconds, resultSize);
+        }
+        if (pResult != NULL)
+        {
+            result.status = 0;
+            result.seconds /= options.repeat;
+        }
+        delete[] pResult;
+
+        getrusage (RUSAGE_SELF, &usage);
+        result.maxRSS = usage.ru_maxrss;
+        if (write (fds[1], &result, sizeof(result)) != sizeof(result))
+            _exit (EXIT_FAILURE);
+        _exit (EXIT_SUCCESS);
+    }
+
+    close (fds[1]);
+    if (pid > 0)
+    {
+        int status;
+        if (read (fds[0], &result, sizeof(result)) != sizeof(result))
+            result.status = -1;
+        if (waitpid (pid, &status, 0) != pid
+         || !WIFEXITED(status)
+         || WEXITSTATUS(status) != EXIT_SUCCESS)
+            result.status = -1;
+    }
+    close (fds[0]);
+    return result;
+}
+
+// Returns the power of the size by which a cost (the time, or with "memory"
+// the peak memory) grew, as the slope of the least-squares line through the
+// logarithms of each step, so that one noisy step does not decide it.
+static double GrowthOf (const ScaleResult* steps, int count, bool memory)
+{
+    double sumX  = 0.0;
+    double sumY  = 0.0;
+    double sumXX = 0.0;
+    double sumXY = 0.0;
+
+    for (int n = 0; n < count; ++n)
+    {
+        double cost = memory ? static_cast<double>(steps[n].maxRSS) : steps[n].seconds;
+        if (cost <= 0.0 || steps[n].bytes <= 0)
+            return 0.0;
+
+        double x = log (static_cast<double>(steps[n].bytes));
+        double y = log (cost);
+        sumX  += x;
+        sumY  += y;
+        sumXX += x * x;
+        sumXY += x * y;
+    }
+
+    double spread = count * sumXX - sumX * sumX;
+    if (count < 2 || spread <= 0.0)
+        return 0.0;
+    return (count * sumXY - sumX * sumY) / spread;
+}
+
+// ----------------------------------------------------------------------------
+// Formats each pathological input at sizes doubling from ScaleUnit to
+// "limit" times that (at most ScaleSteps sizes), reporting the time and peak
+// memory (above that for an empty input) of each.  An input fails if either
+// grows as more than ScaleExponent power of the size, or if formatting it
+// fails.
+//
+// Return Values:
+// int        : number of inputs which failed.
+//
+static int TestScaling (int limit, const Config& userS)
+{
+    int failed = 0;
+    ScaleResult empty = ScaleMeasure (TABLESIZE(ScaleCorpus), 0, userS);
+
+    printf ("# result\tname\tbytes\tseconds\tMB/s\tKB\n");
+    for (size_t n = 0; n < TABLESIZE(ScaleCorpus); ++n)
+    {
+        ScaleResult steps[ScaleSteps];
+        int         count = 0;
+        bool        error = false;
+
+        for (int size = 1; size <= limit && count < ScaleSteps && !error; size *= 2)
+        {
+            ScaleResult& last = steps[count++];
+
+            last = ScaleMeasure (n, ScaleUnit * size, userS);
+            last.maxRSS -= empty.maxRSS;
+            if (last.status != 0)
+                error = true;
+
+            printf ("%s\t%s\t%ld\t%.6f\t%.2f\t%ld\n",
+                    error ? "ERROR" : "scale",
+                    ScaleCorpus[n].name, last.bytes, last.seconds,
+                    (last.seconds > 0.0) ? (last.bytes / last.seconds / 1.0e6) : 0.0,
+                    last.maxRSS);
+        }
+
+        // small amounts of memory are too coarse to judge
+        bool   sizeJudged = (steps[0].maxRSS >= ScaleMinRSS);
+        double timeGrowth = GrowthOf (steps, count, false);
+        double sizeGrowth = sizeJudged ? GrowthOf (steps, count, true) : 0.0;
+
+        bool fail = error
+                 || timeGrowth > ScaleExponent
+                 || sizeGrowth > ScaleExponent;
+        printf ("%s\t%s\ttime ^%.2f", fail ? "FAIL" : "linear",
+                ScaleCorpus[n].name, timeGrowth);
+        if (sizeJudged)
+            printf ("\tmemory ^%.2f\n", sizeGrowth);
+        else
+            printf ("\tmemory -\n");
+        failed += fail ? 1 : 0;
+    }
+    printf ("# %d inputs, %d failed\n", static_cast<int>(TABLESIZE(ScaleCorpus)), failed);
+    return failed;
+}
+
+// ----------------------------------------------------------------------------
+// Comparing styles.  Each file is decoded once for every group of the "-style"
+// configurations which decode alike (SameDecoding), and then formatted with
+// each configuration in a thread of its own.  The result is compared with the
+// original, counting the lines removed and added as diff would.
+
+// One configuration's work on the current file, and its totals.
+struct StyleJob
+{
+    const char*  pName;         // name of the configuration file
+    Config       userS;
+    DecodedFile* pDecoded;      // shared with other jobs for the same file
+    const char*  pData;         // the original text
+    long         size;
+    int          status;        // from FormatDecoded, for this file
+    long         removed;       // lines, for this file
+    long         added;
+    double       seconds;       // processor time of this job's thread
+    int          files;         // totals, over all files
+    int          changed;
+    int          failed;
+    long         allRemoved;
+    long         allAdded;
+    double       allSeconds;
+};
+
+struct StyleLine
+{
+    const char*   pText;
+    long          len;
+    unsigned long hash;
+};
+
+// Returns the processor time used by the calling thread.
+static double ThreadSeconds (void)
+{
+    struct timespec ts;
+    if (clock_gettime (CLOCK_THREAD_CPUTIME_ID, &ts) != 0)
+        return 0.0;
+    return ts.tv_sec + ts.tv_nsec / 1.0e9;
+}
+
+// Splits a buffer into lines, hashing each.  Returns a new array, and sets
+// count to the number of lines.
+static StyleLine* SplitLines (const char* pData, long size, long& count)
+{
+    StyleLine* result = new StyleLine[CountLines (pData, size) + 1];
+
+    count = 0;
+    for (long n = 0; n < size; )
+    {
+        StyleLine& line = result[count++];
+        unsigned long hash = 2166136261UL;
+
+        line.pText = pData + n;
+        while (n < size && pData[n] != LF)
+        {
+            hash = (hash ^ static_cast<unsigned char>(pData[n++])) * 16777619UL;
+        }
+        line.len  = (pData + n) - line.pText;
+        line.hash = hash;
+        ++n;
+    }
+    return result;
+}
+
+static bool SameLine (const StyleLine& one, const StyleLine& two)
+{
+    return one.hash == two.hash
+        && one.len  == two.len
+        && !memcmp (one.pText, two.pText, one.len);
+}
+
+static int CompareHashes (const void* pOne, const void* pTwo)
+{
+    unsigned long one = static_cast<const StyleLine*>(pOne)->hash;
+    unsigned long two = static_cast<const StyleLine*>(pTwo)->hash;
+    return (one < two) ? -1 : (one > two);
+}
+
+// Returns the length of the longest common subsequence of two arrays of
+// lines, using Myers' algorithm, which takes time in proportion to the size
+// of the arrays times the number of differences.  When that would exceed
+// StyleDiffCost, the lines are instead matched regardless of their order,
+// which may count fewer differences, but only for lines which moved.
+static long CommonLines (StyleLine* pOne, long one, StyleLine* pTwo, long two)
+{
+    long  common = 0;
+    long  limit  = one + two;
+    long  cost   = 0;
+
+    if (one == 0 || two == 0)
+        return 0;
+
+    long* pDiag  = new long[2 * limit + 3] + limit + 1;   // indexed -limit-1..limit+1
+
+    pDiag[1] = 0;
+    for (long d = 0; d <= limit; ++d)
+    {
+        for (long k = -d; k <= d; k += 2)
+        {
+            long x = (k == -d || (k != d && pDiag[k - 1] < pDiag[k + 1]))
+                   ? pDiag[k + 1]
+                   : pDiag[k - 1] + 1;
+            long y = x - k;
+
+            while (x < one && y < two && SameLine (pOne[x], pTwo[y]))
+            {
+                ++x;
+                ++y;
+                ++cost;
+            }
+            pDiag[k] = x;
+            if (x >= one && y >= two)
+            {
+                delete[] (pDiag - limit - 1);
+                return (one + two - d) / 2;
+            }
+        }
+        if ((cost += 2 * d + 1) > StyleDiffCost)
+            break;
+    }
+    delete[] (pDiag - limit - 1);
+
+    qsort (pOne, one, sizeof(StyleLine), CompareHashes);
+    qsort (pTwo, two, sizeof(StyleLine), CompareHashes);
+    for (long x = 0, y = 0; x < one && y < two; )
+    {
+        if (pOne[x].hash < pTwo[y].hash)
+            ++x;
+        else if (pOne[x].hash > pTwo[y].hash)
+            ++y;
+        else
+        {
+            ++common;
+            ++x;
+            ++y;
+        }
+    }
+    return common;
+}
+
+// Counts the lines which would be removed from and added to the original to
+// make the result, omitting those which both begin or end with.
+static void CountChanges (const char* pOld, long oldSize, const char* pNew, long newSize,
+                          long& removed, long& added)
+{
+    long       one;
+    long       two;
+    StyleLine* pOne  = SplitLines (pOld, oldSize, one);
+    StyleLine* pTwo  = SplitLines (pNew, newSize, two);
+    long       first = 0;
+
+    while (first < one && first < two && SameLine (pOne[first], pTwo[first]))
+        ++first;
+    while (one > first && two > first && SameLine (pOne[one - 1], pTwo[two - 1]))
+    {
+        --one;
+        --two;
+    }
+
+    long common = CommonLines (pOne + first, one - first, pTwo + first, two - first);
+    removed = one - first - common;
+    added   = two - first - common;
+
+    delete[] pOne;
+    delete[] pTwo;
+}
+
+// The thread for one StyleJob.
+static void* StyleThread (void* pArg)
+{
+    StyleJob& job   = *static_cast<StyleJob*>(pArg);
+    double    start = ThreadSeconds ();
+    long      resultSize;
+    char*     pResult = FormatDecodedBuffer (job.pDecoded, job.userS, resultSize);
+
+    job.status  = (pResult != NULL) ? 0 : -1;
+    job.removed = 0;
+    job.added   = 0;
+    if (pResult != NULL)
+        CountChanges (job.pData, job.size, pResult, resultSize, job.removed, job.added);
+    job.seconds = ThreadSeconds () - start;
+
+    delete[] pResult;
+    return NULL;
+}
+
+// ----------------------------------------------------------------------------
+// Formats one file with each configuration, reporting each which changes it.
+static void StyleOneFile (const char* pInput, const char* pName,
+                          StyleJob* pJobs, int jobs, double& decodeSeconds)
+{
+    long       size;
+    char*      pData = ReadWholeFile (pInput, size);
+    pthread_t  threads[StyleLimit];
+    bool       started[StyleLimit];
+    int        n;
+
+    for (n = 0; n < jobs; ++n)
+    {
+        pJobs[n].pDecoded = NULL;
+        pJobs[n].pData    = pData;
+        pJobs[n].size     = size;
+        pJobs[n].status   = -1;
+    }
+
+    // decode once for each group of configurations which decode alike
+    for (n = 0; pData != NULL && n < jobs; ++n)
+    {
+        FILE* fp = (pJobs[n].pDecoded == NULL) ? fopen (pInput, "r") : NULL;
+        if (fp == NULL)
+            continue;
+
+        double start = ThreadSeconds ();
+        DecodedFile* pDecoded = DecodeFile (fp, pJobs[n].userS);
+        decodeSeconds += ThreadSeconds () - start;
+        fclose (fp);
+
+        for (int k = n; pDecoded != NULL && k < jobs; ++k)
+        {
+            if (pJobs[k].pDecoded == NULL
+             && SameDecoding (pJobs[n].userS, pJobs[k].userS))
+                pJobs[k].pDecoded = pDecoded;
+        }
+    }
+
+    for (n = 0; n < jobs; ++n)
+    {
+        started[n] = (pJobs[n].pDecoded != NULL)
+                  && pthread_create (&threads[n], NULL, StyleThread, &pJobs[n]) == 0;
+    }
+
+    for (n = 0; n < jobs; ++n)
+    {
+        StyleJob& job = pJobs[n];
+
+        if (started[n])
+            pthread_join (threads[n], NULL);
+
+        job.files      += 1;
+        job.allSeconds += job.seconds;
+        if (!started[n] || job.status != 0)
+        {
+            job.failed += 1;
+            printf ("ERROR\t%s\t%s\t-\t-\n", job.pName, pName);
+        }
+        else if (job.removed != 0 || job.added != 0)
+        {
+            job.changed    += 1;
+            job.allRemoved += job.removed;
+            job.allAdded   += job.added;
+            printf ("changed\t%s\t%s\t%ld\t%ld\n", job.pName, pName, job.removed, job.added);
+        }
+    }
+    fflush (stdout);
+
+    // free each decoded file once
+    for (n = jobs - 1; n >= 0; --n)
+    {
+        int k;
+        for (k = 0; k < n && pJobs[k].pDecoded != pJobs[n].pDecoded; ++k)
+            ;
+        if (k == n)
+            FreeDecoded (pJobs[n].pDecoded);
+    }
+    delete[] pData;
+}
+
+// Formats every file in pInDir and its subdirectories.  pPrefix (if non-null)
+// is the path of pInDir below the top, shown before each file-name.
+static int StyleDirectory (const char* pInDir, const char* pPrefix,
+                           StyleJob* pJobs, int jobs, double& decodeSeconds)
+{
+    int count;
+    char** pNames = ListNames (pInDir, false, count);
+
+    if (pNames == NULL)
+    {
+        warning ("Cannot read directory %s\n", pInDir);
+        return -1;
+    }
+    for (int n = 0; n < count; ++n)
+    {
+        char* pInput = PathOf (pInDir, pNames[n]);
+        char* pName  = (pPrefix != NULL) ? PathOf (pPrefix, pNames[n]) : NewString (pNames[n]);
+
+        StyleOneFile (pInput, pName, pJobs, jobs, decodeSeconds);
+        delete[] pInput;
+        delete[] pName;
+    }
+    FreeNames (pNames, count);
+
+    pNames = ListNames (pInDir, true, count);
+    for (int n = 0; n < count; ++n)
+    {
+        char* pSubDir = PathOf (pInDir, pNames[n]);
+        char* pName   = (pPrefix != NULL) ? PathOf (pPrefix, pNames[n]) : NewString (pNames[n]);
+
+        StyleDirectory (pSubDir, pName, pJobs, jobs, decodeSeconds);
+        delete[] pSubDir;
+        delete[] pName;
+    }
+    FreeNames (pNames, count);
+    return 0;
+}
+
+// ----------------------------------------------------------------------------
+// Reports how each configuration would change the files in pInDir, and the
+// totals for each.
+//
+// Return Values:
+// int        : number of files which could not be formatted.
+//
+static int TestStyles (const char* pInDir, const char** pStyles, int styles,
+                       const TestOptions& options)
+{
+    StyleJob* pJobs         = new StyleJob[styles];
+    double    decodeSeconds = 0.0;
+    int       failed        = 0;
+    int       n;
+
+    for (n = 0; n < styles; ++n)
+    {
+        memset (&pJobs[n], 0, sizeof(StyleJob));
+        pJobs[n].pName = pStyles[n];
+        if (LoadConfig (pStyles[n], pJobs[n].userS) != 0)
+        {
+            delete[] pJobs;
+            return -1;
+        }
+    }
+
+    printf ("# result\tstyle\tname\tremoved\tadded\n");
+    StyleDirectory (pInDir, NULL, pJobs, styles, decodeSeconds);
+
+    printf ("# result\tstyle\tfiles\tchanged\tremoved\tadded");
+    if (options.timing)
+        printf ("\tseconds");
+    printf ("\n");
+    for (n = 0; n < styles; ++n)
+    {
+        const StyleJob& job = pJobs[n];
+        printf ("%s\t%s\t%d\t%d\t%ld\t%ld",
+                job.failed ? "FAIL" : "total", job.pName,
+                job.files, job.changed, job.allRemoved, job.allAdded);
+        if (options.timing)
+            printf ("\t%.6f", job.allSeconds);
+        printf ("\n");
+        failed += job.failed;
+    }
+    if (options.timing)
+        printf ("decode\t*\t%d\t-\t-\t-\t%.6f\n", styles ? pJobs[0].files : 0, decodeSeconds);
+    printf ("# %d styles, %d failed\n", styles, failed);
+
+    delete[] pJobs;
+    return failed;
+}
+
+// ----------------------------------------------------------------------------
+static void Usage (void)
+{
+    static const char* text[] =
+    {
+        "Usage: bcpptest [options] [input-dir [output-dir]]",
+        "",
+        "Formats each file in input-dir (default \"input\") and compares it with",
+        "the same name in output-dir (default \"output\").",
+        "",
+        "Options:",
+        "  -fnc <file>  : Configuration file (default bcpp.cfg, if present)",
+        "  -gen <dir>   : Write the synthetic inputs into dir, and exit",
+        "  -n   <num>   : Format each file num times, for timing",
+        "  -nt          : Omit timing columns, to compare reports with diff",
+        "  -scale <num> : Check that pathological inputs scale linearly, up to",
+        "                 num times the smallest size (e.g., 64)",
+        "  -style <file>: Report the lines each such configuration would change",
+        "                 in the files under input-dir (may be repeated)",
+        "  -syn <num>   : Format the synthetic inputs, scaled by num",
+        "  -trace <dir> : Write a trace of each failure into dir, for bcpptrace",
+    };
+    for (size_t n = 0; n < TABLESIZE(text); ++n)
+        warning ("%s\n", text[n]);
+}
+
+int main (int argc, char* argv[])
+{
+    const char* pConfig = NULL;
+    const char* pGenDir = NULL;
+    const char* pInDir  = NULL;
+    const char* pOutDir = NULL;
+    int         scale   = 0;
+    int         limit   = 0;
+    const char* pStyles[StyleLimit];
+    int         styles  = 0;
+    TestOptions options = { 1, true, NULL };
+    TestTotals  totals  = { 0, 0, 0, 0, 0.0 };
+    Config      userS;
+
+    for (int n = 1; n < argc; ++n)
+    {
+        const char* pArg = argv[n];
+        bool hasValue = (n + 1 < argc);
+
+        if (!strcmp (pArg, "-fnc") && hasValue)
+            pConfig = argv[++n];
+        else if (!strcmp (pArg, "-gen") && hasValue)
+            pGenDir = argv[++n];
+        else if (!strcmp (pArg, "-n") && hasValue)
+            options.repeat = atoi (argv[++n]);
+        else if (!strcmp (pArg, "-nt"))
+            options.timing = false;
+        else if (!strcmp (pArg, "-scale") && hasValue)
+            limit = atoi (argv[++n]);
+        else if (!strcmp (pArg, "-style") && hasValue && styles < StyleLimit)
+            pStyles[styles++] = argv[++n];
+        else if (!strcmp (pArg, "-syn") && hasValue)
+            scale = atoi (argv[++n]);
+        else if (!strcmp (pArg, "-trace") && hasValue)
+            options.pTraceDir = argv[++n];
+        else if (*pArg != '-' && pInDir == NULL)
+            pInDir = pArg;
+        else if (*pArg != '-' && pOutDir == NULL)
+            pOutDir = pArg;
+        else
+        {
+            Usage ();
+            return EXIT_FAILURE;
+        }
+    }
+    if (options.repeat < 1)
+        options.repeat = 1;
+
+    if (options.pTraceDir != NULL)
+    {
+        traceEnable (true);
+        traceCrashFile (PathOf (options.pTraceDir, "crash.trc"));
+    }
+
+    if (pConfig == NULL && IsFile ("bcpp.cfg"))
+        pConfig = "bcpp.cfg";
+    if (LoadConfig (pConfig, userS) != 0)
+        return EXIT_FAILURE;
+
+    if (limit > 0)
+        return TestScaling (limit, userS) ? EXIT_FAILURE : EXIT_SUCCESS;
+
+    if (styles > 0)
+        return TestStyles ((pInDir != NULL) ? pInDir : "input", pStyles, styles, options)
+               ? EXIT_FAILURE
+               : EXIT_SUCCESS;
+
+    if (pGenDir != NULL)
+        return TestSynthetic (scale > 0 ? scale : 1, pGenDir, userS, options, totals)
+               ? EXIT_FAILURE
+               : EXIT_SUCCESS;
+
+    ReportHeader (options);
+
+    if (scale > 0)
+    {
+        TestSynthetic (scale, NULL, userS, options, totals);
+    }
+
+    if (pInDir != NULL || scale <= 0)
+    {
+        if (pInDir == NULL)
+            pInDir = "input";
+        if (pOutDir == NULL)
+            pOutDir = "output";
+
+        if (TestDirectory (pInDir, pOutDir, NULL, userS, options, totals) != 0)
+            return EXIT_FAILURE;
+
+        // subdirectories of the input directory which hold test-configs
+        int count;
+        char** pNames = ListNames (pInDir, true, count);
+        for (int n = 0; n < count; ++n)
+        {
+            char* pSubDir  = PathOf (pInDir, pNames[n]);
+            char* pSubCfg  = PathOf (pSubDir, ".bcpp");
+            char* pSubOut  = PathOf (pOutDir, pNames[n]);
+            Config subS;
+
+            if (IsFile (pSubCfg)
+             && LoadConfig (pSubCfg, subS) == 0)
+            {
+                TestDirectory (pInDir, pSubOut, pNames[n], subS, options, totals);
+            }
+            delete[] pSubDir;
+            delete[] pSubCfg;
+            delete[] pSubOut;
+        }
+        FreeNames (pNames, count);
+    }
+
+    ReportLine (totals.failed ? "FAIL" : "total", "*", totals.lines, totals.bytes,
+                totals.seconds, options);
+    printf ("# %d files, %d failed\n", totals.files, totals.failed);
+
+    return totals.failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,48 @@
+// $Id: bcpptrace.cpp$
+// bcpptrace.cpp
+//
+// Decodes the binary traces written by bcpp (when BCPP_TRACE is set, and it
+// crashes) and by bcpptest (with "-trace", for each failure).
+//
+// Usage: bcpptrace file [...]
+//
+// Each event is shown on one line:  the input line being read when it was
+// recorded, the line in bcpp.cpp (or hanging.cpp) of the trace-point, its
+// phase, and the values recorded for that phase.  Traces are only readable
+// by a build with the same TraceRing layout.
+
+#include "bcpp.h"
+
+#include <stdlib.h>
+
+int main (int argc, char* argv[])
+{
+    int status = EXIT_SUCCESS;
+
+    if (argc < 2)
+    {
+        warning ("Usage: bcpptrace file [...]\n");
+        return EXIT_FAILURE;
+    }
+
+    for (int n = 1; n < argc; ++n)
+    {
+        FILE* fp = fopen (argv[n], "rb");
+
+        if (fp == NULL)
+        {
+            warning ("Cannot open %s\n", argv[n]);
+            status = EXIT_FAILURE;
+            continue;
+        }
+        if (argc > 2)
+            printf ("# %s\n", argv[n]);
+        if (traceDecode (fp, stdout) < 0)
+        {
+            warning ("%s is not a bcpp trace\n", argv[n]);
+            status = EXIT_FAILURE;
+        }
+        fclose (fp);
+    }
+    return status;
+}
@@ -72,7 +72,7 @@ void PrintProgramHelp (void)
             "-i   <num>    : Indent space length",
             "-lg           : Leave graphic chars",
             "-nc  <num>    : Column to align comments with no code",
-            "-qb  <num>    : Define internal queue buffer size",
+            "-qb  <num>    : Define most lines held for lookahead",
             "-s            : Use spaces in indenting",
             "-t            : Use tabs in indenting",
             "-tbcl         : Top-level open braces on code line",
@@ -477,6 +477,52 @@ int SetConfig (FILE* pConfigFile, Config& userSettings)
   return configError;
 }
 
+// @@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@
+// This function is used to set the default configuration, before reading
+// the configuration file and command line.
+//
+// Parameters:
+// userSettings : Config structure that will contain the default settings.
+//
+void DefaultConfig (Config& userSettings)
+{
+    const Config defaults = {2,      // numOfLineFunc
+                             4,      // tabSpaceSize
+                             False,  // useTabs
+                             50,     // posOfCommentsWC
+                             0,      // posOfCommentsNC
+                             False,  // keepCommentsWC
+                             False,  // leaveCommentsNC
+                             False,  // quoteChars
+                             3,      // deleteHighChars
+                             True,   // topBraceLoc
+                             True,   // braceLoc
+                             True,   // output
+                             100,    // queueBuffer
+                             False,  // backUp
+                             False,  // indentPreP
+                             False,  // indent_sql
+                             False,  // braceIndent
+                             False,  // braceIndent2
+                             2};     // fillMode
+
+    userSettings = defaults;
+}
+
+// @@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@
+// This function is used to compute the settings that are derived from the
+// users configuration, so that they are not worked out again for each line.
+//
+// Parameters:
+// userSettings : Config structure that contains the user settings.
+//
+void CompileConfig (Config& userSettings)
+{
+    userSettings.fillMode = 2;              // we can always use spaces
+    if (userSettings.useTabs == True)
+        userSettings.fillMode |= 1;         // set bit 0, tabs
+}
+
 // @@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@
 // This function is used to show the users configuration.
 //
@@ -487,7 +533,7 @@ int SetConfig (FILE* pConfigFile, Config& userSettings)
 // int          : Returns the number of errors encountered when reading the
 //                configuration file.
 //
-int ShowConfig (Config& userSettings)
+int ShowConfig (const Config& userSettings)
 {
     const char* choices[2] = {"Yes", "No"};
     int errorNum = 0;
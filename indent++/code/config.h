@@ -30,7 +30,9 @@ const char SQUOTE = '\'';
 const char ESCAPE = '\\';
 
 // This structure is used to store the users settings that are read from a
-// configuration file.
+// configuration file.  Once CompileConfig() has filled in the derived fields
+// it is only read, so one Config may be shared by several threads formatting
+// different files.
 struct Config
 {
   int     numOfLineFunc  ;  // number of lines between functions
@@ -46,12 +48,15 @@ struct Config
   Boolean topBraceLoc    ;  // True = place on new line, False = at end of code
   Boolean braceLoc       ;  // True = place on new line, False = at end of code
   Boolean output         ;  // Set this True for normal program output
-  int     queueBuffer    ;  // Set the number if lines to store in memory at a time !
+  int     queueBuffer    ;  // Set the most lines to store in memory at a time !
   Boolean backUp         ;  // backup the original file, have output file become input file name !
   Boolean indentPreP     ;  // indent preprocessor controls to match code
   Boolean indent_sql     ;  // indent embedded SQL statements
   Boolean braceIndent    ;  // True = indent trailing brace, False = don't
   Boolean braceIndent2   ;  // True = indent both braces, False = don't
+
+  // derived by CompileConfig(), not read from the configuration file
+  int     fillMode       ;  // bit 0 = indent with tabs, bit 1 = spaces
 };
 
 
@@ -67,6 +72,15 @@ struct Config
 char* ReadLine (FILE *pInFile, int& EndOfFile);
 
 
+// @@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@
+// This function is used to set the default configuration, before reading
+// the configuration file and command line.
+//
+// Parameters:
+// userSettings : Config structure that will contain the default settings.
+//
+extern void DefaultConfig (Config& userSettings);
+
 // @@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@
 // This function is used to load the users configuration from a file.
 //
@@ -93,6 +107,16 @@ extern int SetConfig (FILE* pConfigFile, Config& userSettings);
 // int          : Returns the number of errors encountered when reading the
 //                configuration file.
 //
-extern int ShowConfig(Config& userSettings);
+extern int ShowConfig(const Config& userSettings);
+
+// @@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@@
+// This function is used to compute the settings derived from the users
+// configuration, once it has been completely read.  It must be called before
+// the Config is passed to ProcessFile().
+//
+// Parameters:
+// userSettings : Config structure that contains the user settings.
+//
+extern void CompileConfig (Config& userSettings);
 
 #endif
@@ -22,9 +22,15 @@
 
 #include <stdlib.h>
 #include <stdarg.h>
+#include <signal.h>
 
 #include "bcpp.h"
 
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#include <fcntl.h>
+#endif
+
 void trace(const char *format, ...)
 {
     va_list ap;
@@ -33,7 +39,126 @@ void trace(const char *format, ...)
     va_end(ap);
 }
 
-#if defined(DEBUG) || defined(DEBUG2)
+//-----------------------------------------------------------------------------
+// Binary trace ring buffer
+
+static const char traceMagic[8] = "BCPPTR1";
+
+TRACE_TLS TraceRing *pTraceRing = 0;
+
+static const char *pCrashName = 0;
+
+// Turns the binary trace on or off for the calling thread.
+void traceEnable(bool enable)
+{
+    if (enable && pTraceRing == 0)
+    {
+        pTraceRing = new TraceRing;
+        memset(pTraceRing, 0, sizeof(TraceRing));
+        memcpy(pTraceRing->magic, traceMagic, sizeof(traceMagic));
+        pTraceRing->size = TraceRingSize;
+    }
+    else if (!enable && pTraceRing != 0)
+    {
+        delete pTraceRing;
+        pTraceRing = 0;
+    }
+}
+
+// Empties the ring, at the start of a file.
+void traceStart(const char *name)
+{
+    if (pTraceRing != 0)
+    {
+        pTraceRing->next = 0;
+        pTraceRing->line = 0;
+        strncpy(pTraceRing->name, (name != 0) ? name : "",
+                sizeof(pTraceRing->name) - 1);
+        pTraceRing->name[sizeof(pTraceRing->name) - 1] = NULLC;
+    }
+}
+
+static short traceShort(int value)
+{
+    if (value > 32767)
+        value = 32767;
+    else if (value < -32768)
+        value = -32768;
+    return static_cast<short>(value);
+}
+
+void traceRecord(int phase, int kind, int site, int v0, int v1, int v2, int v3)
+{
+    TraceEvent *pEvent = &pTraceRing->event[pTraceRing->next++ & (TraceRingSize - 1)];
+
+    pEvent->phase    = static_cast<unsigned char>(phase);
+    pEvent->kind     = static_cast<unsigned char>(kind);
+    pEvent->site     = static_cast<unsigned short>(site);
+    pEvent->line     = pTraceRing->line;
+    pEvent->value[0] = traceShort(v0);
+    pEvent->value[1] = traceShort(v1);
+    pEvent->value[2] = traceShort(v2);
+    pEvent->value[3] = traceShort(v3);
+}
+
+// Writes the calling thread's ring to a file, for bcpptrace.  Returns false
+// if there is no ring, or it cannot be written.
+bool traceDump(const char *filename)
+{
+    bool result = false;
+
+    if (pTraceRing != 0)
+    {
+        FILE *fp = fopen(filename, "wb");
+        if (fp != 0)
+        {
+            result = (fwrite(pTraceRing, sizeof(TraceRing), 1, fp) == 1);
+            if (fclose(fp) != 0)
+                result = false;
+        }
+    }
+    return result;
+}
+
+// The ring is written as-is, with only async-signal-safe calls where we have
+// them, and the signal is then raised again with its default action.
+static void traceCrash(int sig)
+{
+    signal(sig, SIG_DFL);
+    if (pTraceRing != 0 && pCrashName != 0)
+    {
+#ifdef HAVE_UNISTD_H
+        int fd = open(pCrashName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd >= 0)
+        {
+            ssize_t written = write(fd, pTraceRing, sizeof(TraceRing));
+            (void) written;     // nothing more can be done about it here
+            close(fd);
+        }
+#else
+        traceDump(pCrashName);
+#endif
+    }
+    raise(sig);
+}
+
+// Installs handlers for the fatal signals, which write the trace of the
+// thread that failed to the given file.
+void traceCrashFile(const char *filename)
+{
+    static const int fatal[] =
+    {
+        SIGSEGV, SIGFPE, SIGILL, SIGABRT,
+#ifdef SIGBUS
+        SIGBUS,
+#endif
+    };
+
+    pCrashName = filename;
+    for (size_t n = 0; n < TABLESIZE(fatal); ++n)
+        signal(fatal[n], traceCrash);
+}
+
 static const char *traceDataType(DataTypes theType)
 {
     const char *it;
@@ -64,6 +189,69 @@ static const char *traceIndentAttr(IndentAttr theType)
     return it;
 }
 
+//-----------------------------------------------------------------------------
+// Decodes a ring written by traceDump, oldest event first.  Returns the
+// number of events, or -1 if the file is not a trace from this build.
+int traceDecode(FILE *pInFile, FILE *pOutFile)
+{
+    static const char *phases[] = { "input", "indent", "output" };
+    TraceRing *pRing = new TraceRing;
+    int result = -1;
+
+    if (fread(pRing, sizeof(TraceRing), 1, pInFile) == 1
+     && memcmp(pRing->magic, traceMagic, sizeof(traceMagic)) == 0
+     && pRing->size == static_cast<unsigned>(TraceRingSize))
+    {
+        unsigned int first = 0;
+
+        result = 0;
+        if (pRing->next > pRing->size)
+            first = pRing->next - pRing->size;
+
+        fprintf(pOutFile, "# %s: %u events, %u shown, at line %d\n",
+                pRing->name, pRing->next, pRing->next - first, pRing->line);
+
+        for (unsigned int n = first; n != pRing->next; ++n)
+        {
+            const TraceEvent *pEvent = &pRing->event[n & (TraceRingSize - 1)];
+            const short *value = pEvent->value;
+
+            fprintf(pOutFile, "%6d @%-5u %-6s ",
+                    pEvent->line,
+                    pEvent->site,
+                    (pEvent->phase < TABLESIZE(phases)) ? phases[pEvent->phase] : "?");
+            switch (pEvent->phase)
+            {
+                case trInput:
+                    fprintf(pOutFile, "%s%s (col:%d)\n",
+                            traceDataType(static_cast<DataTypes>(pEvent->kind)),
+                            value[1] ? " comWcode" : "",
+                            value[0]);
+                    break;
+                case trIndent:
+                    fprintf(pOutFile, "%s (pos:%d, single:%d)\n",
+                            traceIndentAttr(static_cast<IndentAttr>(pEvent->kind)),
+                            value[0], value[1]);
+                    break;
+                case trOutput:
+                    fprintf(pOutFile, "%s indent %d(%d) fill %d braces %d\n",
+                            traceDataType(static_cast<DataTypes>(pEvent->kind)),
+                            value[0], value[1], value[2], value[3]);
+                    break;
+                default:
+                    fprintf(pOutFile, "%d %d %d %d\n",
+                            value[0], value[1], value[2], value[3]);
+                    break;
+            }
+            ++result;
+        }
+    }
+    delete pRing;
+    return result;
+}
+
+#if defined(DEBUG) || defined(DEBUG2)
+
 void traceInput(const char *file, int line, InputStruct *pIn)
 {
     if (pIn != 0)
@@ -76,6 +264,7 @@ void traceInput(const char *file, int line, InputStruct *pIn)
         if (pIn->pData  != 0) TRACE(("---- data:%s\n", pIn->pData));
         if (pIn->pState != 0) TRACE(("---- flag:%s\n", pIn->pState));
     }
+    traceInputEvent(line, pIn);
 }
 
 void traceIndent(const char *file, int line, IndentStruct *pIn)
@@ -87,6 +276,7 @@ void traceIndent(const char *file, int line, IndentStruct *pIn)
             traceIndentAttr(pIn->attrib),
             pIn->pos));
     }
+    traceIndentEvent(line, pIn);
 }
 
 void traceOutput(const char *file, int line, OutputStruct *pOut)
@@ -109,5 +299,6 @@ void traceOutput(const char *file, int line, OutputStruct *pOut)
         if (pOut->pBFlag)   TRACE(("---- state:%s\n", pOut->pBFlag));
         if (pOut->pComment) TRACE(("-- comment:%s\n", pOut->pComment));
     }
+    traceOutputEvent(line, pOut);
 }
 #endif
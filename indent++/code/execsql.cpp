@@ -21,10 +21,144 @@
 // EXEC SQL parsing & indention
 
 #include <ctype.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "bcpp.h"
-#include "cmdline.h"        // StrUpr()
+
+// The sequences of keywords which begin or end an SQL block or statement are
+// recognized by a small automaton, whose transitions are compiled in:
+//
+//      EXEC SQL BEGIN DECLARE SECTION      begin declaration   (DeclSQL)
+//      EXEC SQL END DECLARE SECTION        end declaration     (NotSQL)
+//      EXEC SQL EXECUTE BEGIN              begin statement     (BeginSQL)
+//      END-EXEC                            end statement       (NotSQL)
+//
+// A word which is not one of these keywords, or punctuation, restarts it.
+
+enum SqlToken {
+    tkExec = 0,
+    tkSql,
+    tkExecute,
+    tkBegin,
+    tkEndExec,
+    tkEnd,
+    tkDeclare,
+    tkSection,
+    tkOther
+};
+
+enum SqlNode {
+    snStart = 0,        // nothing matched
+    snExec,             // EXEC
+    snExecSql,          // EXEC SQL
+    snBegin,            // EXEC SQL BEGIN
+    snBeginDecl,        // EXEC SQL BEGIN DECLARE
+    snEnd,              // EXEC SQL END
+    snEndDecl,          // EXEC SQL END DECLARE
+    snExecute,          // EXEC SQL EXECUTE
+    snSqlMore,          // EXEC SQL, then keywords which match nothing
+    snNoMatch,          // keywords which match nothing
+    // final nodes, which set the state and restart the automaton
+    snDeclare,
+    snUndeclare,
+    snStatement,
+    snEndStatement
+};
+
+static const struct {
+    const char *name;
+    size_t len;
+} sql_keys[] = {
+    { "EXEC",     4 },      // tkExec
+    { "SQL",      3 },      // tkSql
+    { "EXECUTE",  7 },      // tkExecute
+    { "BEGIN",    5 },      // tkBegin
+    { "END-EXEC", 8 },      // tkEndExec
+    { "END",      3 },      // tkEnd
+    { "DECLARE",  7 },      // tkDeclare
+    { "SECTION",  7 },      // tkSection
+};
+
+#define N snNoMatch
+#define M snSqlMore
+static const unsigned char sql_next[][tkOther] = {
+    //  EXEC    SQL        EXECUTE    BEGIN        END-EXEC        END    DECLARE      SECTION
+    {   snExec, N,         N,         N,           snEndStatement, N,     N,           N           }, // snStart
+    {   N,      snExecSql, N,         N,           N,              N,     N,           N           }, // snExec
+    {   M,      M,         snExecute, snBegin,     M,              snEnd, M,           M           }, // snExecSql
+    {   M,      M,         M,         M,           M,              M,     snBeginDecl, M           }, // snBegin
+    {   M,      M,         M,         M,           M,              M,     M,           snDeclare   }, // snBeginDecl
+    {   M,      M,         M,         M,           M,              M,     snEndDecl,   M           }, // snEnd
+    {   M,      M,         M,         M,           M,              M,     M,           snUndeclare }, // snEndDecl
+    {   M,      M,         M,         snStatement, M,              M,     M,           M           }, // snExecute
+    {   M,      M,         M,         M,           M,              M,     M,           M           }, // snSqlMore
+    {   N,      N,         N,         N,           N,              N,     N,           N           }, // snNoMatch
+};
+#undef N
+#undef M
+
+static const SqlState sql_final[] = {
+    DeclSQL,            // snDeclare
+    NotSQL,             // snUndeclare
+    BeginSQL,           // snStatement
+    NotSQL,             // snEndStatement
+};
+
+// Compare, ignoring case, with an upper-case keyword of the given length.
+static bool
+SameKeyword(const char *code, const char *name, size_t len)
+{
+    for (size_t n = 0; n < len; n++)
+    {
+        if (toupper(code[n]) != name[n])
+            return false;
+    }
+    return true;
+}
+
+// Return the keyword token for the word beginning code[n], setting its length.
+static int
+SqlKeyword(const char *code, int n, size_t &len)
+{
+    len = 0;
+    while (isName(code[n + len]))
+        len++;
+
+    // "END-EXEC" is the only keyword which is not a single name; match it
+    // before "END"
+    if (len == 3
+     && SameKeyword(code + n, sql_keys[tkEndExec].name, sql_keys[tkEndExec].len)
+     && !isName(code[n + sql_keys[tkEndExec].len]))
+    {
+        len = sql_keys[tkEndExec].len;
+        return tkEndExec;
+    }
+
+    for (int m = 0; m < tkOther; m++)
+    {
+        if (sql_keys[m].len == len
+         && SameKeyword(code + n, sql_keys[m].name, len))
+            return m;
+    }
+    return tkOther;
+}
+
+// Every keyword-sequence which changes the state from NotSQL contains "EXEC"
+// (as EXEC, EXECUTE or END-EXEC), so a line without it can be passed over.
+static bool
+HasExec(const char *code)
+{
+    for (; *code != NULLC; code++)
+    {
+        if (toupper(code[0]) == 'E'
+         && toupper(code[1]) == 'X'
+         && toupper(code[2]) == 'E'
+         && toupper(code[3]) == 'C')
+            return true;
+    }
+    return false;
+}
 
 // skip to the beginning of the next word, inclusive of the starting position.
 int
@@ -56,12 +190,11 @@ SqlStruct::NextWord(int start, OutputStruct *pOut)
         n++;
     }
 
-    // Maintain the level-counter as the maximum number of words we could
-    // have matched.  Punctuation resets it, since the SQL-keywords don't
-    // bypass normal C/C++ syntax.
+    // Punctuation restarts the keyword automaton, since the SQL-keywords
+    // don't bypass normal C/C++ syntax.
     if (reset)
     {
-        matched[level = 0] = NULLC;
+        node = snStart;
         if (state == MoreSQL
          && pOut -> pCFlag[n - 1] == Normal
          && pOut -> pCode[n - 1] == SEMICOLON)
@@ -89,163 +222,154 @@ SqlStruct::SkipWord(int start, OutputStruct *pOut)
     return n;
 }
 
+// keywords which shouldn't be indented, sorted for bsearch()
+static const char *sql_verbs[] = {
+    "ADD",
+    "AND",
+    "APPEND",
+    "AS",
+    "BEGIN",
+    "BETWEEN",
+    "BODY",
+    "BY",
+    "CANCEL",
+    "CHANGE",
+    "CLOSE",
+    "COMMIT",
+    "CONNECT",
+    "CONTAIN",
+    "CONTAINS",
+    "COUNT",
+    "CREATE",
+    "CURRENT",
+    "CURRVAL",
+    "CURSOR",
+    "DECLARE",
+    "DELETE",
+    "DISABLE",
+    "DO",
+    "DROP",
+    "ELSE",
+    "ELSIF",
+    "ENABLE",
+    "END",
+    "ERASE",
+    "EXCEPTION",
+    "EXECUTE",
+    "EXISTS",
+    "FETCH",
+    "FOR",
+    "FROM",
+    "FUNCTION",
+    "GRANT",
+    "GROUP",
+    "HAVING",
+    "IF",
+    "IN",
+    "INCLUDING",
+    "INCREMENT",
+    "INDEX",
+    "INSERT",
+    "INTO",
+    "IS",
+    "LAST",
+    "LIKE",
+    "MAX",
+    "MIN",
+    "MOD",
+    "MODIFY",
+    "NEW",
+    "NEXT",
+    "NEXTVAL",
+    "NOT",
+    "NULL",
+    "NUMBER",
+    "OF",
+    "ON",
+    "ONLY",
+    "OPEN",
+    "OR",
+    "POSITION",
+    "RAISE",
+    "RANGE",
+    "RAW",
+    "READ",
+    "RECOVER",
+    "REM",
+    "RENAME",
+    "REPLACE",
+    "RESUME",
+    "RETURN",
+    "REVERSE",
+    "REVOKE",
+    "ROLLBACK",
+    "ROW",
+    "ROWID",
+    "SELECT",
+    "SEQUENCE",
+    "SET",
+    "SORT",
+    "SQL",
+    "START",
+    "STOP",
+    "TABLE",
+    "THEN",
+    "THIS",
+    "TO",
+    "TRIGGER",
+    "TRUE",
+    "UNDER",
+    "UNION",
+    "UNIQUE",
+    "UNTIL",
+    "UPDATE",
+    "USE",
+    "USING",
+    "VALIDATE",
+    "VALUES",
+    "VIEW",
+    "WHEN",
+    "WHENEVER",
+    "WHERE",
+    "WHILE",
+    "WITH",
+};
+
+static int
+CompareVerb(const void *a, const void *b)
+{
+    return strcmp(static_cast<const char *>(a), *static_cast<const char * const *>(b));
+}
+
 // return true if we've found a keyword which shouldn't be indented
 bool
 SqlStruct::SqlVerb(const char *code)
 {
-    if (!emptyString(code))
+    char word[12];
+    size_t len = 0;
+
+    if (emptyString(code))
+        return false;
+
+    // the verbs are sorted, and are compared with the first word
+    while (isName(code[len]))
     {
-        const char *table[] = {
-            "ADD",
-            "AND",
-            "APPEND",
-            "AS",
-            "BEGIN",
-            "BETWEEN",
-            "BODY",
-            "BY",
-            "CANCEL",
-            "CHANGE",
-            "CLOSE",
-            "COMMIT",
-            "CONNECT",
-            "CONTAIN",
-            "CONTAINS",
-            "COUNT",
-            "CREATE",
-            "CURRENT",
-            "CURRVAL",
-            "CURSOR",
-            "DECLARE",
-            "DELETE",
-            "DISABLE",
-            "DO",
-            "DROP",
-            "ELSE",
-            "ELSIF",
-            "ENABLE",
-            "END",
-            "ERASE",
-            "EXCEPTION",
-            "EXECUTE",
-            "EXISTS",
-            "FETCH",
-            "FOR",
-            "FROM",
-            "FUNCTION",
-            "GRANT",
-            "GROUP",
-            "HAVING",
-            "IF",
-            "IN",
-            "INCLUDING",
-            "INCREMENT",
-            "INDEX",
-            "INSERT",
-            "INTO",
-            "IS",
-            "LAST",
-            "LIKE",
-            "MAX",
-            "MIN",
-            "MOD",
-            "MODIFY",
-            "NEW",
-            "NEXT",
-            "NEXTVAL",
-            "NOT",
-            "NULL",
-            "NUMBER",
-            "OF",
-            "ON",
-            "ONLY",
-            "OPEN",
-            "OR",
-            "POSITION",
-            "RAISE",
-            "RANGE",
-            "RAW",
-            "READ",
-            "RECOVER",
-            "REM",
-            "RENAME",
-            "REPLACE",
-            "RESUME",
-            "RETURN",
-            "REVERSE",
-            "REVOKE",
-            "ROLLBACK",
-            "ROW",
-            "ROWID",
-            "SELECT",
-            "SEQUENCE",
-            "SET",
-            "SORT",
-            "SQL",
-            "START",
-            "STOP",
-            "TABLE",
-            "THEN",
-            "THIS",
-            "TO",
-            "TRIGGER",
-            "TRUE",
-            "UNDER",
-            "UNION",
-            "UNIQUE",
-            "UNTIL",
-            "UPDATE",
-            "USE",
-            "USING",
-            "VALIDATE",
-            "VALUES",
-            "VIEW",
-            "WHEN",
-            "WHENEVER",
-            "WHERE",
-            "WHILE",
-            "WITH",
-        };
-        for (size_t n = 0; n < TABLESIZE(table); n++)
-        {
-            if (CompareKeyword(code, table[n]))
-            {
-                return True;
-            }
-        }
+        if (len + 1 >= sizeof(word))
+            return false;
+        word[len] = static_cast<char>(toupper(code[len]));
+        len++;
     }
-    return False;
+    word[len] = NULLC;
+
+    return bsearch(word, sql_verbs, TABLESIZE(sql_verbs),
+                   sizeof(sql_verbs[0]), CompareVerb) != 0;
 }
 
 void
 SqlStruct::IndentSQL(OutputStruct *pOut)
 {
-    // (Yes, lex/yacc would be more powerful ;-)
-    const struct {
-        const char *name;
-        int code;
-    } state_keys[] = {
-        { "EXEC",      '+' },
-        { "SQL",       'S' },
-        { "EXECUTE",   'x' },
-        { "BEGIN",     'b' },
-        { "END-EXEC",  'E' },   // match this before "END"
-        { "END",       'e' },
-        { "DECLARE",   'd' },
-        { "SECTION",   's' },
-    };
-    const struct {
-        const char *text;
-        SqlState code;
-    } state_strings[] = {
-        { "+Sbds",  DeclSQL },  // begin declaration
-        { "+Seds",  NotSQL },   // end declaration
-        { "+Sxb",   BeginSQL }, // begin statement
-        { "E",      NotSQL },   // end statement
-    };
-
     SqlState old_state = state;
-    char* pUprString = NULL;
+    const char* pCode = NULL;
 
     // First, look for SQL keywords to see when we've entered a block or
     // a statement.  Ignore preprocessor-lines.
@@ -253,57 +377,53 @@ SqlStruct::IndentSQL(OutputStruct *pOut)
      && pOut -> pCode != NULL
      && pOut -> pCFlag != NULL)
     {
-        pUprString = new char[strlen (pOut -> pCode) + 1];
-        if (pUprString == NULL)
-            return;
-
-        StrUpr (strcpy(pUprString, pOut->pCode));
-        TRACE(("esql HERE:%s\n", pUprString));
+        pCode = pOut -> pCode;
+        TRACE(("esql HERE:%s\n", pCode));
         TRACE(("esql FLAG:%s\n", pOut->pCFlag));
 
-        for (int n = NextWord(0, pOut);
-            pOut -> pCode[n] != NULLC;
-                n = NextWord(n, pOut))
+        if (state == NotSQL
+         && (node == snStart || node == snNoMatch)
+         && !HasExec(pCode))
         {
-            bool found = False;
-
-            for (size_t m = 0; m < TABLESIZE(state_keys); m++)
+            node = snStart;     // plain C/C++
+        }
+        else
+        {
+            for (int n = NextWord(0, pOut);
+                pCode[n] != NULLC;
+                    n = NextWord(n, pOut))
             {
-                if (CompareKeyword(pUprString+n, state_keys[m].name))
+                size_t len;
+                int token = SqlKeyword(pCode, n, len);
+
+                if (token != tkOther)
                 {
-                    found = True;
-                    matched[level++] = state_keys[m].code;
-                    matched[level] = NULLC;
-                    n += strlen(state_keys[m].name); // fix for END-EXEC
-                    for (size_t j = 0; j < TABLESIZE(state_strings); j++)
+                    node = sql_next[node][token];
+                    n += len;   // past the keyword, including END-EXEC
+                    if (node >= snDeclare)
                     {
-                        if (!strcmp(state_strings[j].text, matched))
-                        {
-                            state = state_strings[j].code;
-                            matched[level = 0] = NULLC;
-                            break;
-                        }
+                        state = sql_final[node - snDeclare];
+                        node = snStart;
                     }
-                    break;
                 }
-            }
-            if (!found)
-            {
-                if (state == NotSQL
-                 && level >= 2
-                 && !strncmp(matched, "+S", 2))
+                else
                 {
-                    state = MoreSQL;
-                    TRACE(("esql transition to MoreSQL:%s\n", pOut->pCode + n));
+                    if (state == NotSQL
+                     && node >= snExecSql
+                     && node <= snSqlMore)
+                    {
+                        state = MoreSQL;
+                        TRACE(("esql transition to MoreSQL:%s\n", pCode + n));
+                    }
+                    node = snStart;
+                }
+                TRACE(("esql TEST:%s\n", pCode + n));
+                TRACE(("->state:%d, node %d\n", state, node));
+                n = SkipWord(n, pOut);
+                if (pCode[n] == NULLC)
+                {
+                    break;
                 }
-                matched[level = 0] = NULLC;
-            }
-            TRACE(("esql TEST:%s\n", pUprString + n));
-            TRACE(("->state:%d, level %d, matched:%s\n", state, level, matched));
-            n = SkipWord(n, pOut);
-            if (pOut -> pCode[n] == NULLC)
-            {
-                break;
             }
         }
     }
@@ -314,7 +434,7 @@ SqlStruct::IndentSQL(OutputStruct *pOut)
          && old_state != 0)
         {
             pOut -> indentHangs = 1;
-            if ((state == BeginSQL || state == MoreSQL) && !SqlVerb(pUprString))
+            if ((state == BeginSQL || state == MoreSQL) && !SqlVerb(pCode))
                 pOut -> indentHangs = 2;
             TRACE(("esql FIXME-HANG:%d\n", pOut -> indentHangs));
         }
@@ -323,11 +443,9 @@ SqlStruct::IndentSQL(OutputStruct *pOut)
          && old_state == MoreSQL)
         {
             pOut -> indentHangs = 1;
-            if (!SqlVerb(pUprString))
+            if (!SqlVerb(pCode))
                 pOut -> indentHangs = 2;
             TRACE(("esql FIXME-HANG2:%d\n", pOut -> indentHangs));
         }
     }
-
-    delete[] pUprString;
 }
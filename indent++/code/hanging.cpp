@@ -34,14 +34,17 @@ static int endOfKeyword(const char *name, int first)
     return next;
 }
 
-static char* parseKeyword(const char *name, int &next)
+// Copies the name beginning at name[next] into the caller's buffer.  A name
+// too long for the buffer cannot be a keyword, and is returned empty.
+static char* parseKeyword(const char *name, int &next, char *string, unsigned size)
 {
     int first = next;
 
     next = endOfKeyword(name, next);
 
     unsigned len = next + 1 - first;
-    char* string = new char[len + 1];
+    if (len >= size)
+        len = 0;
     strncpy(string, name + first, len)[len] = 0;
 
     return string;
@@ -68,7 +71,8 @@ HangStruct::ScanState(const char *code, const char *state)
                 if (isName(c)
                  && (n == 0 || !isName(code[n-1])))
                 {
-                    char *name = parseKeyword(code, n);
+                    char buffer[40];
+                    char *name = parseKeyword(code, n, buffer, sizeof(buffer));
                     int findWord = LookupKeyword(name);
 
                     TRACE(("lookup '%s' ->%d\n", name, findWord));
@@ -91,7 +95,6 @@ HangStruct::ScanState(const char *code, const char *state)
                             until_parn = 0;
                         indent = 1;
                     }
-                    delete[] name;
                 }
                 else if (!isspace(code[n]))
                 {
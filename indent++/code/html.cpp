@@ -25,36 +25,33 @@
 #include <ctype.h>
 #include <string.h>
 
-static char *
-UpperCase(const char *text)
+// Compares a line with an (upper-case) tag, ignoring leading whitespace and
+// the case of the line.  As with the old trim, the tag need only be followed
+// by whitespace, so "<script> x" begins a script too.
+static bool
+MatchTag(const char *text, const char *tag)
 {
     while (isspace(*text))
         text++;
-    char *temp = new char[strlen(text)+1];
-    strcpy(temp, text);
-    for (int n = strlen(temp); n > 0; n--)
-        if (isspace(temp[n-1]))
-            temp[--n] = 0;
-    StrUpr(temp);
-    return temp;
+    while (*tag != 0) {
+        if (toupper(*text) != *tag)
+            return false;
+        text++;
+        tag++;
+    }
+    return (*text == 0 || isspace(*text));
 }
 
 static bool
 BeginScript(const char *text)
 {
-    char *temp = UpperCase (text);
-    bool code = !strcmp("<SERVER>", temp) || !strcmp("<SCRIPT>", temp);
-    delete[] temp;
-    return code;
+    return MatchTag(text, "<SERVER>") || MatchTag(text, "<SCRIPT>");
 }
 
 static bool
 EndScript(const char *text)
 {
-    char *temp = UpperCase (text);
-    bool code = !strcmp("</SERVER>", temp) || !strcmp("</SCRIPT>", temp);
-    delete[] temp;
-    return code;
+    return MatchTag(text, "</SERVER>") || MatchTag(text, "</SCRIPT>");
 }
 
 bool
@@ -95,3 +92,45 @@ HtmlStruct::Active(const char *pLineData)
     }
     return ((state == 1) || match);
 }
+
+// Reads the next line of an HTML region, after the one which Active() accepted,
+// up to and including the line which begins a script.  A line cut short by the
+// end of the file is not returned, as in ProcessFile().
+//
+// Returns the line, which is reused by the next call, or NULL at the end of
+// the region.
+const char *
+HtmlStruct::NextHtml(FILE *pInFile, int& EndOfFile)
+{
+    int need = 0;
+    int ch;
+
+    if (state != 1 || EndOfFile)
+        return NULL;
+
+    for (;;) {
+        if (need + 2 > bufferSize) {
+            bufferSize = ((need + 2) * 3) / 2;
+            if (bufferSize < 80)
+                bufferSize = 80;
+            char *temp = new char[bufferSize];
+            if (need != 0)
+                memcpy(temp, pBuffer, need);
+            delete[] pBuffer;
+            pBuffer = temp;
+        }
+        ch = fgetc(pInFile);
+        if (ch < 0) {
+            EndOfFile = ch;
+            return NULL;
+        } else if (ch == LF) {
+            break;
+        }
+        pBuffer[need++] = static_cast<char>(ch);
+    }
+    pBuffer[need] = 0;
+
+    if (BeginScript(pBuffer))
+        state = 2;
+    return pBuffer;
+}
@@ -0,0 +1,5 @@
+while (x)
+else
+    foo();}
+{
+int y;
@@ -0,0 +1,8 @@
+int f()
+{
+    x(); /* a
+     */
+    /* b */ y(); /* c
+       d */
+    z();
+}
@@ -0,0 +1,3 @@
+#define MAX(a, b) \
+    ((a) > (b) ? (a) : (b)) /* both are
+                               evaluated twice */
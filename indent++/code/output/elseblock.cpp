@@ -0,0 +1,8 @@
+while (x)
+	else
+		foo();
+}
+
+
+		{
+			int y;
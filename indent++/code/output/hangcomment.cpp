@@ -0,0 +1,9 @@
+int f()
+{
+	x();
+	/* a
+	 */
+	/* b */ y(); /* c
+		   d */
+	z();
+}
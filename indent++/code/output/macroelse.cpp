@@ -0,0 +1,35 @@
+void f()
+{
+	#define _GLIBCXX_PARALLEL_DECISION(__a, __b, __c, __d) { \
+			if (__seq ## __d < __seq ## __a) \
+			goto __s ## __d ## __a ## __b ## __c; \
+			if (__seq ## __d < __seq ## __b) \
+			goto __s ## __a ## __d ## __b ## __c; \
+			if (__seq ## __d < __seq ## __c) \
+			goto __s ## __a ## __b ## __d ## __c; \
+			goto __s ## __a ## __b ## __c ## __d; \
+		}
+
+			if (__seq0 <= __seq1)
+			{
+				if (__seq1 <= __seq2)
+					_GLIBCXX_PARALLEL_DECISION(0,1,2,3)
+						else
+					if (__seq2 < __seq0)
+						_GLIBCXX_PARALLEL_DECISION(2,0,1,3)
+								else
+							_GLIBCXX_PARALLEL_DECISION(0,2,1,3)
+			}
+			else
+			{
+				if (__seq1 <= __seq2)
+				{
+					if (__seq0 <= __seq2)
+						_GLIBCXX_PARALLEL_DECISION(1,0,2,3)
+							else
+							_GLIBCXX_PARALLEL_DECISION(1,2,0,3)
+				}
+				else
+					_GLIBCXX_PARALLEL_DECISION(2,1,0,3)
+			}
+}
@@ -62,6 +62,22 @@ char *NewString (const char *src)
     return dst;
 }
 
+// Allocates a fragment of a line and its state-flags in a single block, the
+// flags following the text.  Deleting the text frees both.
+char *NewFragment (const char *src, const char *state, char *&dstState)
+{
+    size_t len = strlen (src);
+    size_t stateLen = strlen (state);
+    char* dst =  new char[len + stateLen + 2];
+    if (dst != 0)
+    {
+        memcpy(dst, src, len + 1);
+        dstState = dst + len + 1;
+        memcpy(dstState, state, stateLen + 1);
+    }
+    return dst;
+}
+
 char *NewSubstring (const char *src, size_t len)
 {
     char* dst =  new char[len + 1];
@@ -246,24 +246,47 @@ void ExpandTabs (char* &pString,
     Boolean quoteChars,
     CharState &curState, char * &lineState, Boolean &codeOnLine)
 {
+    static char aBlank[] = " ";
+
     int   col = 0;
     int   skip = 0;
+    int   blanks = 0;               // blanks still to write for a tab
     size_t last = 0;
-    char* pSTab = pString;
+    size_t limit = strlen (pString) + 1;
+    char* pIn = pString;            // next character to read
+    char* pText = pString;          // result, written in place until it grows
+    char  quoted[8];                // a non-printing character, quoted
+    char* pQuoted = quoted;
     bool  expand = True;
-    bool  my_pString = False;
     bool  had_print = False;
     CharState oldState = curState;
 
-    lineState = new char[strlen (pString) + 1];
+    lineState = new char[limit];
     if (lineState == 0)
         return;
 
     lineState[0] = NullC;
+    quoted[0] = NULLC;
 
     //TRACE((" ExpandTabs(%s)%s\n", pString, codeOnLine ? " code" : ""))
-    while (*pSTab != NULLC)
+    for (;;)
     {
+        // pSTab points to the character to interpret, followed by those
+        // which were read after it
+        char* pSTab;
+
+        if (blanks > 0)
+        {
+            blanks--;
+            pSTab = aBlank;
+        }
+        else if (*pQuoted != NULLC)
+            pSTab = pQuoted++;
+        else if (*pIn != NULLC)
+            pSTab = pIn++;
+        else
+            break;
+
         col++;
 
         if (isgraph(*pSTab))
@@ -288,47 +311,10 @@ void ExpandTabs (char* &pString,
                 tabAmount = ((((col+tabLen-1) / tabLen)) * tabLen) - col + 1;
 
             //TRACE(("amount:%d, col:%d, state:%s (%d)\n", tabAmount, col, showCharState(curState), had_print))
-            if (tabAmount > 0)
-            {
-                // create newString, remove tab !
-                char* pNewString = new char[strlen (pString) + tabAmount + 1];
-                char* pNewStates = new char[strlen (pString) + tabAmount + 1];
-
-                if (pNewString == NULL
-                 || pNewStates == NULL)
-                {
-                    if (my_pString)
-                    {
-                        delete[] pString;
-                        pString = 0;
-                    }
-                    delete[] lineState;
-                    return;
-                }
-                my_pString = True;
-
-                strcpy (pNewStates, lineState);
-                delete[] lineState;
-                lineState = pNewStates;
-
-                // copy first part
-                strcpy (pNewString, pString);
-
-                // add spaces
-                char *pAddSpc = pNewString + col - 1;
-                while (tabAmount-- > 0)
-                    *pAddSpc++ = SPACE;
-
-                // add original trailing spaces
-                strcpy (pAddSpc, pSTab+1);
-                delete[] pString;               // remove old string from memory
-                pString = pNewString;
-                pSTab   = pString + col - 1;    // point to the first blank
-                //TRACE(("...%d:%s\n", col, pString))
-            }
-            else
-                *pSTab = SPACE;
-
+            // replace the tab by the first blank, and write the rest after
+            if (tabAmount > 1)
+                blanks = tabAmount - 1;
+            pSTab = aBlank;
         }
         // SCCS ID contains a tab that we don't want to touch
         else if (*pSTab == '@' && !strncmp(pSTab+1, "(#)", 3))
@@ -341,47 +327,48 @@ void ExpandTabs (char* &pString,
              && (curState == SQuoted
               || curState == DQuoted)) {
                 char* pOctal = ConvertCharToOctal(*pSTab);
-                char* pTemp = new char[strlen(pString)+strlen(pOctal)+1];
-                if (pOctal == 0 || pTemp == 0)
+                if (pOctal != 0)
                 {
+                    strcpy(quoted, pOctal);
+                    pQuoted = quoted;
                     delete[] pOctal;
-                    delete[] pTemp;
-                    return;
                 }
-                *pSTab = NULLC;
-                strcpy(pTemp, pString);
-                strcat(pTemp, pOctal);
-                strcat(pTemp, pSTab+1);
-                pSTab   = pTemp + (pSTab - pString);
-
-                delete[] pString;
-                pString = pTemp;
-
-                pTemp = new char[strlen(pString)+strlen(pOctal)+1];
-                if (pTemp == 0)
-                {
-                    delete[] pOctal;
-                    delete[] pTemp;
-                    delete[] pString;
-                    pString = NULL;
-                    return;
-                }
-                strcpy(pTemp, lineState);
+            }
+            // else simply remove the character
+            col--;
+            //TRACE(("re-interpret col %d\n", col))
+            continue;   // interpret the quoted characters, if any
+        }
 
-                delete[] lineState;
-                lineState = pTemp;
+        // Writing in place is safe only behind the characters still to be
+        // read; past that (or past the end of a copy), grow the copy.
+        if ((pText == pString)
+            ? (pString + col > pIn)
+            : (static_cast<size_t>(col) + 1 > limit))
+        {
+            size_t grown = (2 * limit) + tabLen;
+            char* pNewText   = new char[grown];
+            char* pNewStates = new char[grown];
 
-                delete[] pOctal;
-            }
-            else    // simply remove the character
+            if (pNewText == NULL
+             || pNewStates == NULL)
             {
-                int n = 0;
-                while ((pSTab[n] = pSTab[n+1]) != NULLC)
-                    n++;
+                if (pText != pString)
+                    delete[] pText;
+                delete[] pNewText;
+                delete[] pNewStates;
+                delete[] pString;
+                pString = 0;
+                return;
             }
-            col--;
-            //TRACE(("re-interpret col %d\n", col))
-            continue;   // re-interpret character
+            memcpy (pNewText,   pText,     col - 1);
+            memcpy (pNewStates, lineState, col - 1);
+            if (pText != pString)
+                delete[] pText;
+            delete[] lineState;
+            pText     = pNewText;
+            lineState = pNewStates;
+            limit     = grown;
         }
 
         if (skip == 0)
@@ -411,8 +398,14 @@ void ExpandTabs (char* &pString,
         }
 
         lineState[col] = NullC;
+        pText[col-1] = *pSTab;
+    }
 
-        pSTab++;
+    pText[col] = NULLC;
+    if (pText != pString)
+    {
+        delete[] pString;               // remove old string from memory
+        pString = pText;
     }
 
     // Set up for the next time through this procedure
@@ -429,7 +422,7 @@ void ExpandTabs (char* &pString,
       || curState == SQuoted))
         curState = Normal;    // recover from syntax error
 
-    if (last < strlen(pString))
+    if (last < static_cast<size_t>(col))
     {
         pString[last] = NULLC;      // trim trailing blanks
         lineState[last] = NullC;
@@ -441,104 +434,54 @@ void ExpandTabs (char* &pString,
 }
 
 // ----------------------------------------------------------------------------
-// This function is used to allocate memory for indentation within function
-// OutputToOutFile(). Once the memory needed is allocated, it fills the memory
-// with spaces, or tabs depending upon the fill mode.
+// Runs of blanks and tabs, shared (read-only) by every caller of
+// WriteSpacing(), so that indenting a line needs no allocation.
+#define BLANKS_16 "                "
+#define TABS_16   "\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t"
+
+static const char SpacingBlanks[] = BLANKS_16 BLANKS_16 BLANKS_16 BLANKS_16
+                                    BLANKS_16 BLANKS_16 BLANKS_16 BLANKS_16;
+static const char SpacingTabs[]   = TABS_16 TABS_16 TABS_16 TABS_16;
+
+static void WriteRun (FILE* pOutFile, const char* pRun, int runLen, int len)
+{
+    while (len > 0)
+    {
+        int chunk = (len < runLen) ? len : runLen;
+        fwrite (pRun, 1, chunk, pOutFile);
+        len -= chunk;
+    }
+}
+
+// ----------------------------------------------------------------------------
+// This function is used to write indentation within function OutputToOutFile().
+// It writes spaces, or tabs and spaces, depending upon the fill mode of the
+// compiled configuration (see CompileConfig).
 //
 // Parameters:
-// Mode         : Defines the fill mode of the memory that it allocate
-//             1 = tabs only
+// pOutFile  : Output file
+// userS     : Compiled configuration; fillMode and tabSpaceSize are used:
 //             2 = spaces only
-//             3 = both
-// len       : Number of bytes needed to be allocated
-// spaceIndent:Number of memory locations a tab character take up
-//
-// Return Values:
-// char*     : Returns a pointer to the memory/string that was allocated
+//             3 = tabs, with spaces for the remainder
+// col       : Column at which the spacing begins, used for tab-stops
+// len       : Number of columns to fill
 //
-char* TabSpacing (int mode, int col, int len, int spaceIndent)
+void WriteSpacing (FILE* pOutFile, const Config& userS, int col, int len)
 {
-    char* pOutTab = NULL;
-    char* pOutSpc = NULL;
-
-    if ((mode & 1) == 1)
-    {
-        int numOfTabs = 0;
-
-        // bypass exception error
-        if (spaceIndent > 0)
-        {
-           numOfTabs = ((len+col) / spaceIndent) - (col / spaceIndent);
-           if (len != 0)
-               len = (len + col) % spaceIndent;
-        }
-
-        pOutTab = new char[numOfTabs + 1];
-        if (pOutTab != NULL)
-        {
-            for (int fillTabs = 0; fillTabs < numOfTabs; fillTabs++)
-                    pOutTab[fillTabs] = TAB;
-            pOutTab[numOfTabs] = NULLC;
-        }
-        else
-            return NULL; // memory allocation failed
-
-        // If not in both tab, and space concatenation.
-        if ((mode & 2) == 0)
-              return pOutTab;
-    }//bit 0 set !
-
-    if ((mode & 2) == 2)
-    {
-        if (pOutTab == NULL) //##### normal space allocation !
-        {
-            pOutSpc = new char[len+1];
-            if (pOutSpc != NULL)
-            {
-                for (int fillSpcs = 0; fillSpcs < len; fillSpcs++)
-                    pOutSpc[fillSpcs] = SPACE;
-                pOutSpc[len] = NULLC;
-                return pOutSpc;   //##### return end product
-            }
-            else
-                return NULL;    // memory allocation failed
-        }
-        else  // else a mix of spaces & tabs
-        {
-            int numOfSpcs = 0;
-
-            if (spaceIndent > 0)
-               numOfSpcs = len % spaceIndent;
-
-            pOutSpc = new char[numOfSpcs+1];
-            if (pOutSpc != NULL)
-            {
-                for (int fillSpcs = 0; fillSpcs < numOfSpcs; fillSpcs++)
-                    pOutSpc[fillSpcs] = SPACE;
-                pOutSpc[numOfSpcs] = NULLC;
-            }
-            else
-                return NULL; // memory allocation failed
-        }
-    }// bit 1 set
+    int numOfTabs = 0;
+    int numOfSpcs = len;
 
-    //##### Concatenate tabs & spaces
-    if ( ((mode & 1) == 1) && ((mode & 2) == 2) )
+    if ((userS.fillMode & 1) == 1)
     {
-        char* pConCat = new char[(strlen (pOutTab) + strlen (pOutSpc) + 1)];
-        // #### Check memory allocation
-        if (pConCat == NULL)
+        numOfSpcs = 0;
+        if (userS.tabSpaceSize > 0)
         {
-            delete[] pOutTab;
-            delete[] pOutSpc;
-            return NULL;
+            numOfTabs = ((len + col) / userS.tabSpaceSize) - (col / userS.tabSpaceSize);
+            if (len != 0)
+                numOfSpcs = (len + col) % userS.tabSpaceSize;
         }
-        strcpy (pConCat, pOutTab);
-        strcpy (pConCat + strlen (pConCat), pOutSpc);
-        delete[] pOutTab;
-        delete[] pOutSpc;
-        return pConCat;
     }
 
-    return NULL; //##### illegal mode passed !
+    WriteRun (pOutFile, SpacingTabs,   sizeof(SpacingTabs) - 1,   numOfTabs);
+    WriteRun (pOutFile, SpacingBlanks, sizeof(SpacingBlanks) - 1, numOfSpcs);
 }
@@ -0,0 +1,444 @@
+/**
+   \file externalSort.h
+
+   Sorts a file of fixed-size records that may be larger than memory,
+   using the in-memory sorts in sort.h:
+
+   - Run generation reads the file in chunks that fit the memory
+     budget, sorts each with parallelMergeSort, and writes it to a
+     temporary file as a sorted run.
+
+   - Merging combines up to fanIn runs at a time with a loser tree,
+     reading each run through its own large buffer with pread and
+     writing the result with large sequential writes.  Each group of
+     fanIn runs is merged into one longer run as soon as the group is
+     written, and so on up through the levels of longer runs, deleting
+     each input run once it has been read.  So only about fanIn runs
+     per level are ever open, however many chunks the input has.  The
+     runs left over at the end are merged the same way until one merge
+     can write the output.
+
+   Records are trivially copyable structs, stored in the file in
+   native byte order with no header.  Ties keep their order from the
+   input, so the sort is stable.  Temporary files take at most about
+   twice the size of the input.
+
+   POSIX only.  Requires C++11 and -pthread, as sort.h.
+
+   \author Morgan McGuire, morgan@cs.williams.edu.
+
+   http://graphics.cs.williams.edu
+   http://cs.williams.edu/~morgan/code/
+
+   License: BSD (see download page)
+ */
+#ifndef externalSort_h
+#define externalSort_h
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+#include "sort.h"
+
+/** Limits for externalSort */
+struct ExternalSortOptions {
+    /** Bytes of records held in memory at once: each chunk during run
+        generation holds half of this, and its sort scratch the other
+        half; during a merge, it is divided among the input buffers
+        and the output buffer (merges during run generation use the
+        chunk's half) */
+    size_t      memoryBytes;
+
+    /** Most runs merged at once.  Each gets memoryBytes / (fanIn + 1)
+        bytes of buffer, which should be at least a megabyte or so for
+        reads to be sequential in practice. */
+    int         fanIn;
+
+    /** Directory for the runs; by default $TMPDIR, else /tmp */
+    const char* tempDir;
+
+    /** Threads for sorting each chunk; by default SortPool::common() */
+    SortPool*   pool;
+
+    ExternalSortOptions() : memoryBytes(256 << 20), fanIn(64), tempDir(NULL), pool(NULL) {}
+};
+
+namespace _internal {
+
+/** A sorted run in a temporary file.  The file is unlinked as soon as
+    it is created, so that it is deleted when the run is closed, or
+    when the process exits, however it exits. */
+class SortRun {
+public:
+    int         fd;
+    size_t      records;
+
+    SortRun() : fd(-1), records(0) {}
+
+    /** Creates an empty run in dir */
+    bool create(const char* dir) {
+        std::string name = std::string(dir) + "/sortrunXXXXXX";
+        std::vector<char> buffer(name.begin(), name.end());
+        buffer.push_back('\0');
+        fd = mkstemp(&buffer[0]);
+        records = 0;
+        if (fd < 0) return false;
+        unlink(&buffer[0]);
+        return true;
+    }
+
+    void close() {
+        if (fd >= 0) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+};
+
+/** Writes all of the bytes, retrying short writes */
+inline bool writeAll(int fd, const void* data, size_t bytes) {
+    const char* p = (const char*)data;
+    while (bytes > 0) {
+        const ssize_t n = ::write(fd, p, bytes);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        p += n;
+        bytes -= n;
+    }
+    return true;
+}
+
+/** Reads up to bytes from offset, retrying short reads.  Returns the
+    number of bytes read, or -1. */
+inline ssize_t readAt(int fd, void* data, size_t bytes, off_t offset) {
+    char* p = (char*)data;
+    size_t done = 0;
+    while (done < bytes) {
+        const ssize_t n = pread(fd, p + done, bytes - done, offset + done);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (n == 0) break;
+        done += n;
+    }
+    return (ssize_t)done;
+}
+
+/** Sequential reader of the records of a run, through a buffer */
+template<class T>
+class RunReader {
+public:
+    RunReader() : m_fd(-1), m_buffer(NULL), m_capacity(0), m_next(0), m_count(0), m_offset(0), m_remaining(0), m_failed(false) {}
+
+    void open(int fd, size_t records, T* buffer, size_t capacity) {
+        m_fd        = fd;
+        m_buffer    = buffer;
+        m_capacity  = capacity;
+        m_next      = 0;
+        m_count     = 0;
+        m_offset    = 0;
+        m_remaining = records;
+        m_failed    = false;
+#       ifdef POSIX_FADV_SEQUENTIAL
+            posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#       endif
+        fill();
+    }
+
+    bool empty() const {
+        return m_next == m_count;
+    }
+
+    bool failed() const {
+        return m_failed;
+    }
+
+    const T& front() const {
+        return m_buffer[m_next];
+    }
+
+    void pop() {
+        if (++m_next == m_count) fill();
+    }
+
+private:
+    int    m_fd;
+    T*     m_buffer;
+    size_t m_capacity;
+    size_t m_next;
+    size_t m_count;
+    off_t  m_offset;
+    size_t m_remaining;
+    bool   m_failed;
+
+    void fill() {
+        m_next  = 0;
+        m_count = std::min(m_capacity, m_remaining);
+        if (m_count == 0) return;
+
+        const size_t bytes = m_count * sizeof(T);
+        if (readAt(m_fd, m_buffer, bytes, m_offset) != (ssize_t)bytes) {
+            m_failed = true;
+            m_count = 0;
+            return;
+        }
+        m_offset    += bytes;
+        m_remaining -= m_count;
+    }
+};
+
+/** Tournament of k sorted sequences, which keeps at each internal
+    node the loser of the match played there, so that replacing the
+    winner needs one match per level, against the stored losers
+    only.  Node n has children 2n and 2n + 1; sequence i is leaf
+    k + i, and node 0 holds the overall winner.  Exhausted sequences
+    lose every match, and equal keys go to the lower sequence. */
+template<class T, class KeyOf, class Less>
+class LoserTree {
+public:
+    LoserTree(std::vector<RunReader<T> >& reader, KeyOf& keyOf, Less& less) :
+        m_reader(reader), m_keyOf(keyOf), m_less(less), m_k((int)reader.size()), m_node(std::max(1, m_k)) {
+
+        // Play every match once, bottom up, from the winners below
+        std::vector<int> winner(2 * m_k);
+        for (int i = 0; i < m_k; ++i) {
+            winner[m_k + i] = i;
+        }
+        for (int n = m_k - 1; n >= 1; --n) {
+            const int a = winner[2 * n];
+            const int b = winner[2 * n + 1];
+            if (beats(a, b)) {
+                winner[n] = a;
+                m_node[n] = b;
+            } else {
+                winner[n] = b;
+                m_node[n] = a;
+            }
+        }
+        m_node[0] = (m_k <= 1) ? 0 : winner[1];
+    }
+
+    /** The sequence holding the least element, or -1 if all are empty */
+    int winner() const {
+        return ((m_k == 0) || m_reader[m_node[0]].empty()) ? -1 : m_node[0];
+    }
+
+    /** Replays the matches on the path of the winner, after its
+        sequence has advanced */
+    void replay() {
+        int w = m_node[0];
+        for (int n = (m_k + w) / 2; n >= 1; n /= 2) {
+            if (beats(m_node[n], w)) std::swap(m_node[n], w);
+        }
+        m_node[0] = w;
+    }
+
+private:
+    std::vector<RunReader<T> >& m_reader;
+    KeyOf&                      m_keyOf;
+    Less&                       m_less;
+    const int                   m_k;
+    std::vector<int>            m_node;
+
+    bool beats(int a, int b) const {
+        if (m_reader[a].empty()) return false;
+        if (m_reader[b].empty()) return true;
+        if (m_less(m_keyOf(m_reader[a].front()), m_keyOf(m_reader[b].front()))) return true;
+        if (m_less(m_keyOf(m_reader[b].front()), m_keyOf(m_reader[a].front()))) return false;
+        return a < b;
+    }
+};
+
+/** Merges run[first, last) into outFd, through buffer[0, records),
+    which must hold at least last - first + 1 records.  Returns false
+    on an I/O error. */
+template<class T, class KeyOf, class Less>
+bool mergeRuns(std::vector<SortRun>& run, size_t first, size_t last, int outFd, T* buffer, size_t records, KeyOf& keyOf, Less& less) {
+    const size_t k = last - first;
+    const size_t capacity = records / (k + 1);
+
+    std::vector<RunReader<T> > reader(k);
+    for (size_t i = 0; i < k; ++i) {
+        reader[i].open(run[first + i].fd, run[first + i].records, &buffer[i * capacity], capacity);
+    }
+
+    T* out = &buffer[k * capacity];
+    size_t n = 0;
+
+    LoserTree<T, KeyOf, Less> tree(reader, keyOf, less);
+    for (int w = tree.winner(); w >= 0; w = tree.winner()) {
+        out[n++] = reader[w].front();
+        if (n == capacity) {
+            if (! writeAll(outFd, out, n * sizeof(T))) return false;
+            n = 0;
+        }
+        reader[w].pop();
+        tree.replay();
+    }
+
+    for (size_t i = 0; i < k; ++i) {
+        if (reader[i].failed()) return false;
+    }
+    return writeAll(outFd, out, n * sizeof(T));
+}
+
+inline bool failExternalSort(std::vector<SortRun>& run, int inFd, int outFd) {
+    for (size_t i = 0; i < run.size(); ++i) {
+        run[i].close();
+    }
+    if (inFd >= 0) ::close(inFd);
+    if (outFd >= 0) ::close(outFd);
+    return false;
+}
+
+
+/** Merges run[first, last), in order, into a new run appended to
+    next, and closes them.  Returns false on an I/O error. */
+template<class T, class KeyOf, class Less>
+bool mergeGroup(std::vector<SortRun>& run, size_t first, size_t last, std::vector<SortRun>& next, const char* dir, T* buffer, size_t records, KeyOf& keyOf, Less& less) {
+    next.push_back(SortRun());
+    SortRun& merged = next.back();
+    if (! merged.create(dir) || ! mergeRuns<T>(run, first, last, merged.fd, buffer, records, keyOf, less)) {
+        return false;
+    }
+    for (size_t i = first; i < last; ++i) {
+        merged.records += run[i].records;
+        run[i].close();
+    }
+    return true;
+}
+
+/** Closes every run of every level */
+inline void closeLevels(std::vector<std::vector<SortRun> >& level) {
+    for (size_t l = 0; l < level.size(); ++l) {
+        for (size_t i = 0; i < level[l].size(); ++i) {
+            level[l][i].close();
+        }
+    }
+}
+
+} // namespace _internal
+
+
+/** Sorts the records of type T in the file inPath into the file
+    outPath (which may be the same file), by keyOf and less as in
+    sort.h, within the limits of options.  Returns false if a file
+    could not be read or written, or inPath is not a whole number of
+    records. */
+template<class T, class KeyOf, class Less>
+bool externalSort(const char* inPath, const char* outPath, KeyOf keyOf, Less less, const ExternalSortOptions& options = ExternalSortOptions()) {
+    using namespace _internal;
+    static_assert(std::is_trivially_copyable<T>::value, "externalSort records must be trivially copyable");
+
+    const char* dir = options.tempDir;
+    if (dir == NULL) dir = getenv("TMPDIR");
+    if (dir == NULL) dir = "/tmp";
+
+    SortPool& pool = (options.pool != NULL) ? *options.pool : SortPool::common();
+    const int fanIn = std::max(2, options.fanIn);
+    std::vector<SortRun> run;
+
+    int inFd = open(inPath, O_RDONLY);
+    struct stat info;
+    if ((inFd < 0) || (fstat(inFd, &info) != 0) || (info.st_size % sizeof(T) != 0)) {
+        return failExternalSort(run, inFd, -1);
+    }
+
+    // An empty input has no runs to merge, and needs no merge buffers
+    const size_t records = info.st_size / sizeof(T);
+    if (records == 0) {
+        ::close(inFd);
+        const int outFd = open(outPath, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        return (outFd >= 0) && (::close(outFd) == 0);
+    }
+
+    // Run generation.  Runs are kept in levels: when fanIn runs have
+    // accumulated in a level, they are merged through the chunk buffer
+    // into one run at the end of the next level, so that at most about
+    // fanIn runs per level are open at once, however large the input.
+    // Each level's runs follow those of the level above it in input
+    // order.
+    {
+        const size_t chunk = std::max((size_t)fanIn + 1, options.memoryBytes / (2 * sizeof(T)));
+        std::vector<T> buffer(std::min(chunk, std::max(records, (size_t)fanIn + 1)));
+        std::vector<std::vector<SortRun> > level(1);
+#       ifdef POSIX_FADV_SEQUENTIAL
+            posix_fadvise(inFd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#       endif
+
+        for (size_t done = 0; done < records; done += chunk) {
+            const size_t n = std::min(chunk, records - done);
+            const size_t bytes = n * sizeof(T);
+            if (readAt(inFd, &buffer[0], bytes, (off_t)(done * sizeof(T))) != (ssize_t)bytes) {
+                closeLevels(level);
+                return failExternalSort(run, inFd, -1);
+            }
+
+            parallelMergeSort(&buffer[0], &buffer[0] + n, keyOf, less, pool);
+
+            level[0].push_back(SortRun());
+            if (! level[0].back().create(dir) || ! writeAll(level[0].back().fd, &buffer[0], bytes)) {
+                closeLevels(level);
+                return failExternalSort(run, inFd, -1);
+            }
+            level[0].back().records = n;
+
+            for (size_t l = 0; level[l].size() == (size_t)fanIn; ++l) {
+                if (l + 1 == level.size()) level.push_back(std::vector<SortRun>());
+                if (! mergeGroup<T>(level[l], 0, fanIn, level[l + 1], dir, &buffer[0], buffer.size(), keyOf, less)) {
+                    closeLevels(level);
+                    return failExternalSort(run, inFd, -1);
+                }
+                level[l].clear();
+            }
+        }
+
+        for (size_t l = level.size(); l > 0; --l) {
+            run.insert(run.end(), level[l - 1].begin(), level[l - 1].end());
+        }
+    }
+    ::close(inFd);
+    inFd = -1;
+
+    // Merge each consecutive group of fanIn runs into one, keeping the
+    // runs in input order so that ties do too, until one merge remains
+    const size_t mergeRecords = std::min(options.memoryBytes / sizeof(T), (records + 1) * (fanIn + 1));
+    std::vector<T> buffer(std::max((size_t)fanIn + 1, mergeRecords));
+    while (run.size() > (size_t)fanIn) {
+        std::vector<SortRun> next;
+        for (size_t first = 0; first < run.size(); first += fanIn) {
+            const size_t last = std::min(first + fanIn, run.size());
+            if (! mergeGroup<T>(run, first, last, next, dir, &buffer[0], buffer.size(), keyOf, less)) {
+                failExternalSort(next, -1, -1);
+                return failExternalSort(run, -1, -1);
+            }
+        }
+        run.swap(next);
+    }
+
+    int outFd = open(outPath, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if ((outFd < 0) || ! mergeRuns<T>(run, 0, run.size(), outFd, &buffer[0], buffer.size(), keyOf, less)) {
+        return failExternalSort(run, -1, outFd);
+    }
+    for (size_t i = 0; i < run.size(); ++i) {
+        run[i].close();
+    }
+    return ::close(outFd) == 0;
+}
+
+template<class T, class KeyOf>
+bool externalSort(const char* inPath, const char* outPath, KeyOf keyOf, const ExternalSortOptions& options = ExternalSortOptions()) {
+    return externalSort<T>(inPath, outPath, keyOf, KeyLess(), options);
+}
+
+#endif
@@ -0,0 +1,2864 @@
+/**
+   \file sort.h
+
+   Generic versions of the reference sorting algorithms in sort.cpp,
+   as header-only templates:
+
+   - heapSort (on a heap with 4 children per node)
+   - insertionSort
+   - mergeSort
+   - powerSort (stable, adaptive to runs already in the input)
+   - quickSort (introsort)
+   - quickSort2 (indexes an array, without iterators)
+   - radixSort, parallelRadixSort (arrays with float keys)
+   - parallelMergeSort, parallelQuickSort (arrays, on a SortPool)
+   - sortKeys (sorting networks for 4 to 32 float keys with indices)
+   - sortNetwork<N> (sorting networks for N known at compile time)
+   - tagSort, tagSortIndex, permute (sorting keys and indices, then
+     moving each element once)
+   - select, partialSort, TopK (placing the kth element, or only the
+     least k)
+   - PriorityQueue (a d-ary heap with decreaseKey)
+
+   Each sorts the random access range [first, last) in place, from
+   least to greatest by keyOf(element), comparing keys with
+   less(keyA, keyB).  keyOf defaults to SelfKey and less to KeyLess
+   (operator<); use MemberKey for records with a "key" member, as in
+   sort.cpp:
+
+   <pre>
+     struct RenderRecord { float key; ... };
+     std::vector<RenderRecord> v;
+     quickSort(v.begin(), v.end(), MemberKey());
+   </pre>
+
+   The sorts that need O(N) scratch space take it from the caller,
+   through an overload with a scratch argument, or else from the
+   calling thread's SortArena, which grows to the largest size
+   needed and is kept for the next call.  Once it has grown, the
+   sequential sorts do not allocate.  Elements that are not trivially copyable need
+   constructed scratch, which is allocated on each call unless the
+   caller provides it.
+
+   Elements are moved rather than copied, and exchanged with
+   swap() (found by argument-dependent lookup), so an element that
+   owns memory is never deep-copied.  Elements that are trivially
+   copyable are instead moved in blocks with memmove and memcpy when
+   sorting arrays.
+
+   Define SORT_INSTRUMENT before including sort.h to count the
+   comparisons, moves, and recursion depth of the comparison sorts in
+   SortCounters.  Otherwise the counting compiles to nothing.
+
+   Requires C++11.  sortKeys, and with it the last step of quickSort
+   on float keys, uses AVX2 or SSE4.1 when compiled for them (e.g.
+   -mavx2, or -march=native).  The parallel sorts use std::thread, so programs
+   that call them must be linked with -pthread.
+
+   \author Morgan McGuire, morgan@cs.williams.edu.
+
+   http://graphics.cs.williams.edu
+   http://cs.williams.edu/~morgan/code/
+
+   License: BSD (see download page)
+ */
+#ifndef sort_h
+#define sort_h
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#if defined(__SSE4_1__)
+#   include <immintrin.h>
+#endif
+
+/** Key extractor for elements that have a "key" member, such as Element */
+struct MemberKey {
+    template<class T>
+    auto operator()(const T& x) const -> decltype((x.key)) {
+        return x.key;
+    }
+};
+
+/** Key extractor for elements that are their own keys */
+struct SelfKey {
+    template<class T>
+    const T& operator()(const T& x) const {
+        return x;
+    }
+};
+
+/** Orders keys with operator< */
+struct KeyLess {
+    template<class K>
+    bool operator()(const K& a, const K& b) const {
+        return a < b;
+    }
+};
+
+
+/** Scratch memory that is reused by the sorts on one thread.  It
+    grows to the largest request and is freed with the thread. */
+class SortArena {
+public:
+    SortArena() : m_data(NULL), m_size(0) {}
+
+    ~SortArena() {
+        free(m_data);
+    }
+
+    /** Returns at least bytes of uninitialized memory, valid until
+        the next call */
+    void* reserve(size_t bytes) {
+        if (bytes > m_size) {
+            free(m_data);
+            m_size = std::max(bytes, 2 * m_size);
+            m_data = malloc(m_size);
+            if (m_data == NULL) {
+                m_size = 0;
+                throw std::bad_alloc();
+            }
+        }
+        return m_data;
+    }
+
+    /** Bytes currently held */
+    size_t size() const {
+        return m_size;
+    }
+
+    /** The calling thread's arena */
+    static SortArena& local() {
+        static thread_local SortArena arena;
+        return arena;
+    }
+
+private:
+    void*  m_data;
+    size_t m_size;
+
+    SortArena(const SortArena&);
+    SortArena& operator=(const SortArena&);
+};
+
+
+/** The work done by insertionSort, heapSort, mergeSort, quickSort,
+    and quickSort2 on one thread, counted only when sort.h is
+    compiled with SORT_INSTRUMENT defined.  A swap counts as three
+    moves, and memmove and memcpy count each element that they move.
+    The parallel sorts count only the calling thread's share. */
+struct SortCounters {
+    /** Calls to less */
+    uint64_t comparisons;
+
+    /** Elements moved or copied, including by swaps */
+    uint64_t moves;
+
+    uint64_t swaps;
+
+    /** Current and greatest depth of quickSort's and quickSort2's
+        recursion */
+    int      depth;
+    int      maxDepth;
+
+    SortCounters() {
+        reset();
+    }
+
+    void reset() {
+        comparisons = moves = swaps = 0;
+        depth = maxDepth = 0;
+    }
+
+    /** The calling thread's counters */
+    static SortCounters& local() {
+        static thread_local SortCounters counters;
+        return counters;
+    }
+};
+
+
+namespace _internal {
+
+/** Instrumentation policy that counts nothing, and compiles away */
+struct NoInstrument {
+    static const bool enabled = false;
+    static void compared() {}
+    static void moved(size_t) {}
+    static void swapped() {}
+
+    /** Marks one level of recursion for its lifetime */
+    class Level {
+    public:
+        Level() {}
+    };
+};
+
+/** Instrumentation policy that updates SortCounters::local() */
+struct CountInstrument {
+    static const bool enabled = true;
+
+    static void compared() {
+        ++SortCounters::local().comparisons;
+    }
+
+    static void moved(size_t n) {
+        SortCounters::local().moves += n;
+    }
+
+    static void swapped() {
+        SortCounters& counters = SortCounters::local();
+        ++counters.swaps;
+        counters.moves += 3;
+    }
+
+    class Level {
+    public:
+        Level() {
+            SortCounters& counters = SortCounters::local();
+            counters.maxDepth = std::max(counters.maxDepth, ++counters.depth);
+        }
+
+        ~Level() {
+            --SortCounters::local().depth;
+        }
+    };
+};
+
+} // namespace _internal
+
+#ifdef SORT_INSTRUMENT
+typedef _internal::CountInstrument SortInstrument;
+#else
+typedef _internal::NoInstrument SortInstrument;
+#endif
+
+
+namespace _internal {
+
+/** Scratch space for N elements: from the thread's SortArena when the
+    elements are trivially copyable, else constructed in a vector */
+template<class T, bool trivial = std::is_trivially_copyable<T>::value>
+class Scratch {
+public:
+    explicit Scratch(size_t N) : m_data((T*)SortArena::local().reserve(N * sizeof(T))) {}
+    T* data() { return m_data; }
+private:
+    T* m_data;
+};
+
+template<class T>
+class Scratch<T, false> {
+public:
+    explicit Scratch(size_t N) : m_data(N) {}
+    T* data() { return m_data.data(); }
+private:
+    std::vector<T> m_data;
+};
+
+/** Exchanges two elements by swap(), which may be specialized for the type */
+template<class Iterator>
+inline void swapElements(Iterator a, Iterator b) {
+    using std::swap;
+    SortInstrument::swapped();
+    swap(*a, *b);
+}
+
+/** Index version of swapElements, for quickSort2 */
+template<class Array>
+inline void swapElements(Array& element, int a, int b) {
+    using std::swap;
+    SortInstrument::swapped();
+    swap(element[a], element[b]);
+}
+
+/** less(a, b), counted as a comparison by SortInstrument */
+template<class Less, class A, class B>
+inline bool compareKeys(Less& less, const A& a, const B& b) {
+    SortInstrument::compared();
+    return less(a, b);
+}
+
+/** Moves [first, last) one place to the right.  Trivially copyable
+    elements of an array are moved together by memmove. */
+template<class Iterator>
+inline void shiftRight(Iterator first, Iterator last) {
+    SortInstrument::moved(std::distance(first, last));
+    std::move_backward(first, last, std::next(last));
+}
+
+template<class T>
+inline void shiftRight(T* first, T* last, std::true_type) {
+    memmove(first + 1, first, (last - first) * sizeof(T));
+}
+
+template<class T>
+inline void shiftRight(T* first, T* last, std::false_type) {
+    std::move_backward(first, last, last + 1);
+}
+
+template<class T>
+inline void shiftRight(T* first, T* last) {
+    SortInstrument::moved(last - first);
+    shiftRight(first, last, std::integral_constant<bool, std::is_trivially_copyable<T>::value>());
+}
+
+/** The type of a partition's pivot key: a copy when the key is small
+    and trivially copyable, so that it can stay in a register across
+    the swaps, else a reference to the key in the pivot element */
+template<class KeyOf, class T>
+struct PivotKey {
+    typedef typename std::decay<decltype(std::declval<KeyOf&>()(std::declval<const T&>()))>::type Key;
+    typedef typename std::conditional<std::is_trivially_copyable<Key>::value && (sizeof(Key) <= 16),
+                                      const Key, const Key&>::type type;
+};
+
+/** floor(log2(N)), for the introsort depth limit of 2 log2(N) */
+inline int floorLog2(size_t N) {
+    int log = 0;
+    while (N > 1) {
+        N /= 2;
+        ++log;
+    }
+    return log;
+}
+
+/** Returns whichever of a, b, and c has the median key */
+template<class Iterator, class KeyOf, class Less>
+inline Iterator median3(Iterator a, Iterator b, Iterator c, KeyOf& keyOf, Less& less) {
+    if (compareKeys(less, keyOf(*a), keyOf(*b))) {
+        return compareKeys(less, keyOf(*b), keyOf(*c)) ? b : (compareKeys(less, keyOf(*a), keyOf(*c)) ? c : a);
+    } else {
+        return compareKeys(less, keyOf(*a), keyOf(*c)) ? a : (compareKeys(less, keyOf(*b), keyOf(*c)) ? c : b);
+    }
+}
+
+/** Chooses a pivot for [first, first + N): the median of the first,
+    middle, and last keys, or for large N the median of three such
+    medians (Tukey's ninther) */
+template<class Iterator, class KeyOf, class Less>
+inline Iterator choosePivot(Iterator first, ptrdiff_t N, KeyOf& keyOf, Less& less) {
+    const Iterator mid  = first + N / 2;
+    const Iterator last = first + (N - 1);
+
+    if (N > 128) {
+        const ptrdiff_t s = N / 8;
+        return median3(median3(first, first + s, first + 2 * s, keyOf, less),
+                       median3(mid - s, mid, mid + s, keyOf, less),
+                       median3(last - 2 * s, last - s, last, keyOf, less),
+                       keyOf, less);
+    } else {
+        return median3(first, mid, last, keyOf, less);
+    }
+}
+
+/** Index version of median3, for quickSort2 */
+template<class Array, class KeyOf, class Less>
+inline int median3(Array& element, int a, int b, int c, KeyOf& keyOf, Less& less) {
+    if (compareKeys(less, keyOf(element[a]), keyOf(element[b]))) {
+        return compareKeys(less, keyOf(element[b]), keyOf(element[c])) ? b : (compareKeys(less, keyOf(element[a]), keyOf(element[c])) ? c : a);
+    } else {
+        return compareKeys(less, keyOf(element[a]), keyOf(element[c])) ? a : (compareKeys(less, keyOf(element[b]), keyOf(element[c])) ? c : b);
+    }
+}
+
+/** Index version of choosePivot, for quickSort2 */
+template<class Array, class KeyOf, class Less>
+inline int choosePivot(Array& element, const int start, const int N, KeyOf& keyOf, Less& less) {
+    const int mid  = start + N / 2;
+    const int last = start + N - 1;
+
+    if (N > 128) {
+        const int s = N / 8;
+        return median3(element,
+                       median3(element, start, start + s, start + 2 * s, keyOf, less),
+                       median3(element, mid - s, mid, mid + s, keyOf, less),
+                       median3(element, last - 2 * s, last - s, last, keyOf, less),
+                       keyOf, less);
+    } else {
+        return median3(element, start, mid, last, keyOf, less);
+    }
+}
+
+} // namespace _internal
+
+/** Partitions of at most this many elements are left for
+    insertionSort, which was the fastest sort for N <= 16 */
+static const int quickSortCutoff = 16;
+
+///////////////////////////////////////////////////////////////////////////////
+
+template<class Iterator, class KeyOf, class Less>
+void insertionSort(Iterator first, Iterator last, KeyOf keyOf, Less less) {
+    typedef typename std::iterator_traits<Iterator>::value_type T;
+
+    if (first == last) return;
+
+    // Treat elements [first, next) as sorted and the rest to be a
+    // bucket of values awaiting sorting.
+    for (Iterator next = std::next(first); next != last; ++next) {
+        if (! _internal::compareKeys(less, keyOf(*next), keyOf(*std::prev(next)))) {
+            // Already in place
+            continue;
+        }
+
+        // Find where the next element belongs
+        T temp(std::move(*next));
+        Iterator i = std::prev(next);
+        while ((i != first) && _internal::compareKeys(less, keyOf(temp), keyOf(*std::prev(i)))) {
+            --i;
+        }
+
+        // Move the larger elements up, and re-insert temp
+        _internal::shiftRight(i, next);
+        *i = std::move(temp);
+        SortInstrument::moved(2);
+    }
+}
+
+template<class Iterator, class KeyOf>
+void insertionSort(Iterator first, Iterator last, KeyOf keyOf) {
+    insertionSort(first, last, keyOf, KeyLess());
+}
+
+template<class Iterator>
+void insertionSort(Iterator first, Iterator last) {
+    insertionSort(first, last, SelfKey(), KeyLess());
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+/** heapSort's heap has this many children per node.  Four children
+    share one or two cache lines, and a sift visits half the levels
+    of a binary heap. */
+static const int heapSortArity = 4;
+
+namespace _internal {
+
+/** Hints that p will be read soon */
+inline void prefetch(const void* p) {
+#   if defined(__GNUC__)
+        __builtin_prefetch(p);
+#   else
+        (void)p;
+#   endif
+}
+
+/** The greatest of first[child, child + D), for D a power of two, by
+    a tournament of pairs.  The index arithmetic replaces a branch on
+    each comparison, and the pairs at each round are independent. */
+template<int D>
+struct ChildTournament {
+    template<class Iterator, class KeyOf, class Less>
+    static ptrdiff_t winner(Iterator first, const ptrdiff_t child, KeyOf& keyOf, Less& less) {
+        const ptrdiff_t a = ChildTournament<D / 2>::winner(first, child, keyOf, less);
+        const ptrdiff_t b = ChildTournament<D / 2>::winner(first, child + D / 2, keyOf, less);
+        return a + (b - a) * (ptrdiff_t)compareKeys(less, keyOf(first[a]), keyOf(first[b]));
+    }
+};
+
+template<>
+struct ChildTournament<1> {
+    template<class Iterator, class KeyOf, class Less>
+    static ptrdiff_t winner(Iterator, const ptrdiff_t child, KeyOf&, Less&) {
+        return child;
+    }
+};
+
+/** The child of greatest key among first[child, min(child + D - 1, end)] */
+template<int D, class Iterator, class KeyOf, class Less>
+inline ptrdiff_t greatestChild(Iterator first, const ptrdiff_t child, const ptrdiff_t end, KeyOf& keyOf, Less& less) {
+    static_assert((D >= 2) && ((D & (D - 1)) == 0), "Heap arity must be a power of two");
+
+    if (child + D - 1 <= end) {
+        return ChildTournament<D>::winner(first, child, keyOf, less);
+    } else {
+        // The last parent may have fewer children
+        ptrdiff_t maxChild = child;
+        for (ptrdiff_t c = child + 1; c <= end; ++c) {
+            maxChild = compareKeys(less, keyOf(first[maxChild]), keyOf(first[c])) ? c : maxChild;
+        }
+        return maxChild;
+    }
+}
+
+} // namespace _internal
+
+/** Sift first[parent] down the heap first[0, end], in which the
+    children of node i are first[D * i + 1, D * i + D].  D defaults
+    to 2, a binary heap. */
+template<int D = 2, class Iterator, class KeyOf, class Less>
+void siftDown(Iterator first, ptrdiff_t parent, const ptrdiff_t end, KeyOf& keyOf, Less& less) {
+    typedef typename std::iterator_traits<Iterator>::value_type T;
+
+    T value(std::move(first[parent]));
+
+    ptrdiff_t child = parent * D + 1;
+    while (child <= end) {
+        // Fetch the children of all of the children while choosing
+        // among them.  Without this, the loads of large heaps wait on
+        // each other, since which child is next depends on the last.
+        if ((child + D) * D <= end) {
+            for (int c = 0; c < D; ++c) {
+                _internal::prefetch(&first[(child + c) * D + 1]);
+            }
+        }
+
+        const ptrdiff_t maxChild = _internal::greatestChild<D>(first, child, end, keyOf, less);
+
+        // Stop when the parent is at least as large as the max child
+        if (! _internal::compareKeys(less, keyOf(value), keyOf(first[maxChild]))) break;
+
+        first[parent] = std::move(first[maxChild]);
+        SortInstrument::moved(1);
+
+        parent = maxChild;
+        child = parent * D + 1;
+    }
+
+    first[parent] = std::move(value);
+    SortInstrument::moved(2);
+}
+
+/** Forms a max heap of arity D on first[0, N) */
+template<int D = 2, class Iterator, class KeyOf, class Less>
+void heapify(Iterator first, const ptrdiff_t N, KeyOf& keyOf, Less& less) {
+    if (N < 2) return;
+    for (ptrdiff_t i = (N - 2) / D; i >= 0; --i) {
+        siftDown<D>(first, i, N - 1, keyOf, less);
+    }
+}
+
+
+template<class Iterator, class KeyOf, class Less>
+void heapSort(Iterator first, Iterator last, KeyOf keyOf, Less less) {
+    const ptrdiff_t N = last - first;
+    if (N < 2) return;
+
+    heapify<heapSortArity>(first, N, keyOf, less);
+
+    for (ptrdiff_t i = N - 1; i >= 1; --i) {
+        _internal::swapElements(first, first + i);
+        siftDown<heapSortArity>(first, 0, i - 1, keyOf, less);
+    }
+}
+
+template<class Iterator, class KeyOf>
+void heapSort(Iterator first, Iterator last, KeyOf keyOf) {
+    heapSort(first, last, keyOf, KeyLess());
+}
+
+template<class Iterator>
+void heapSort(Iterator first, Iterator last) {
+    heapSort(first, last, SelfKey(), KeyLess());
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+namespace _internal {
+
+/** Allocates blocks aligned to cache lines, for PriorityQueue */
+template<class T>
+class CacheAlignedAllocator {
+public:
+    typedef T value_type;
+
+    enum { alignment = 64 };
+
+    CacheAlignedAllocator() {}
+
+    template<class U>
+    CacheAlignedAllocator(const CacheAlignedAllocator<U>&) {}
+
+    /** The block is preceded by the pointer that malloc returned */
+    T* allocate(size_t n) {
+        char* raw = (char*)malloc(n * sizeof(T) + alignment + sizeof(void*));
+        if (raw == NULL) throw std::bad_alloc();
+        char* aligned = (char*)(((uintptr_t)(raw + sizeof(void*)) + alignment - 1) & ~(uintptr_t)(alignment - 1));
+        ((void**)aligned)[-1] = raw;
+        return (T*)aligned;
+    }
+
+    void deallocate(T* p, size_t) {
+        free(((void**)p)[-1]);
+    }
+
+    template<class U>
+    struct rebind {
+        typedef CacheAlignedAllocator<U> other;
+    };
+
+    template<class U>
+    bool operator==(const CacheAlignedAllocator<U>&) const { return true; }
+
+    template<class U>
+    bool operator!=(const CacheAlignedAllocator<U>&) const { return false; }
+};
+
+} // namespace _internal
+
+/** A priority queue of elements of type T, from which the least
+    element by keyOf and less (as for the sorts) is taken first, such
+    as the earliest of a set of scheduled events:
+
+    <pre>
+      struct Event { double key; ... };
+      PriorityQueue<Event, MemberKey> queue;
+      PriorityQueue<Event, MemberKey>::Handle h = queue.push(event);
+      ...
+      event.key = sooner;
+      queue.decreaseKey(h, event);
+      ...
+      while (! queue.empty()) {
+          process(queue.top());
+          queue.pop();
+      }
+    </pre>
+
+    It is a heap in which each node has D children (a power of two),
+    as in heapSort.  Each push returns a handle to the element, by
+    which decreaseKey finds it; the handle is valid until the element
+    is popped, after which it may be reused.  push, pop, and
+    decreaseKey take O(log N) time; assign forms the heap from a
+    range in O(N).
+
+    The storage is aligned to a cache line and the root placed so that
+    the D children of each node start at a multiple of D entries, so
+    the children share one cache line when D * (sizeof(T) + 4) is at
+    most 64 and divides it.  T must be default constructible.
+*/
+template<class T, class KeyOf = SelfKey, class Less = KeyLess, int D = 4>
+class PriorityQueue {
+public:
+    typedef uint32_t Handle;
+
+    explicit PriorityQueue(KeyOf keyOf = KeyOf(), Less less = Less()) :
+        m_entry(D - 1), m_position(), m_free(), m_keyOf(keyOf), m_less(less) {}
+
+    size_t size() const {
+        return m_entry.size() - (D - 1);
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+    /** The least element.  Requires ! empty(). */
+    const T& top() const {
+        return m_entry[D - 1].value;
+    }
+
+    /** The handle of top() */
+    Handle topHandle() const {
+        return m_entry[D - 1].handle;
+    }
+
+    /** True if the element with this handle is in the queue */
+    bool contains(Handle h) const {
+        return (h < m_position.size()) && (m_position[h] != npos);
+    }
+
+    Handle push(T value) {
+        const Handle h = newHandle();
+        Entry e;
+        e.value = std::move(value);
+        e.handle = h;
+        m_entry.push_back(std::move(e));
+        siftUp(size() - 1);
+        return h;
+    }
+
+    /** Removes top().  Requires ! empty(). */
+    void pop() {
+        Entry* node = nodes();
+        release(node[0].handle);
+        const ptrdiff_t last = size() - 1;
+        if (last > 0) {
+            node[0] = std::move(node[last]);
+            m_entry.pop_back();
+            siftDown(0);
+        } else {
+            m_entry.pop_back();
+        }
+    }
+
+    /** Replaces the element with handle h by value, whose key must not
+        be greater than that of the element it replaces */
+    void decreaseKey(Handle h, T value) {
+        const size_t i = m_position[h];
+        nodes()[i].value = std::move(value);
+        siftUp(i);
+    }
+
+    /** Replaces the contents of the queue with [first, last), whose
+        elements receive the handles 0, 1, 2, ... in order */
+    template<class Iterator>
+    void assign(Iterator first, Iterator last) {
+        clear();
+        for (Handle h = 0; first != last; ++first, ++h) {
+            Entry e;
+            e.value = *first;
+            e.handle = h;
+            m_entry.push_back(std::move(e));
+            m_position.push_back(h);
+        }
+
+        EntryKey entryKey(m_keyOf);
+        Greater greater(m_less);
+        heapify<D>(nodes(), (ptrdiff_t)size(), entryKey, greater);
+        for (size_t i = 0; i < size(); ++i) {
+            m_position[nodes()[i].handle] = i;
+        }
+    }
+
+    void clear() {
+        m_entry.resize(D - 1);
+        m_position.clear();
+        m_free.clear();
+    }
+
+private:
+    struct Entry {
+        T      value;
+        Handle handle;
+    };
+
+    /** keyOf of an entry's value */
+    struct EntryKey {
+        KeyOf& keyOf;
+        explicit EntryKey(KeyOf& keyOf) : keyOf(keyOf) {}
+        auto operator()(const Entry& e) const -> decltype(keyOf(e.value)) {
+            return keyOf(e.value);
+        }
+    };
+
+    /** The heap keeps the greatest on top, so it is given less with
+        the arguments exchanged */
+    struct Greater {
+        Less& less;
+        explicit Greater(Less& less) : less(less) {}
+        template<class K>
+        bool operator()(const K& a, const K& b) const {
+            return less(b, a);
+        }
+    };
+
+    static const size_t npos = (size_t)-1;
+
+    /** The first D - 1 entries are padding, which places the root so
+        that the children of each node are aligned */
+    std::vector<Entry, _internal::CacheAlignedAllocator<Entry> > m_entry;
+
+    /** Node index of each handle, or npos */
+    std::vector<size_t> m_position;
+
+    /** Handles of popped elements, for reuse */
+    std::vector<Handle> m_free;
+
+    KeyOf          m_keyOf;
+    Less           m_less;
+
+    Entry* nodes() {
+        return m_entry.data() + (D - 1);
+    }
+
+    Handle newHandle() {
+        if (m_free.empty()) {
+            m_position.push_back(size_t(npos));
+            return (Handle)(m_position.size() - 1);
+        } else {
+            const Handle h = m_free.back();
+            m_free.pop_back();
+            return h;
+        }
+    }
+
+    void release(Handle h) {
+        m_position[h] = npos;
+        m_free.push_back(h);
+    }
+
+    /** Moves node i up to its place, tracking positions */
+    void siftUp(size_t i) {
+        Entry* node = nodes();
+        Entry e(std::move(node[i]));
+        while (i > 0) {
+            const size_t parent = (i - 1) / D;
+            if (! m_less(m_keyOf(e.value), m_keyOf(node[parent].value))) break;
+            node[i] = std::move(node[parent]);
+            m_position[node[i].handle] = i;
+            i = parent;
+        }
+        m_position[e.handle] = i;
+        node[i] = std::move(e);
+    }
+
+    /** siftDown of node i, tracking positions */
+    void siftDown(size_t i) {
+        Entry* node = nodes();
+        const ptrdiff_t end = (ptrdiff_t)size() - 1;
+        EntryKey entryKey(m_keyOf);
+        Greater greater(m_less);
+
+        Entry e(std::move(node[i]));
+        ptrdiff_t child = (ptrdiff_t)i * D + 1;
+        while (child <= end) {
+            if ((child + D) * D <= end) {
+                for (int c = 0; c < D; ++c) {
+                    _internal::prefetch(&node[(child + c) * D + 1]);
+                }
+            }
+
+            const ptrdiff_t least = _internal::greatestChild<D>(node, child, end, entryKey, greater);
+            if (! m_less(m_keyOf(node[least].value), m_keyOf(e.value))) break;
+            node[i] = std::move(node[least]);
+            m_position[node[i].handle] = i;
+            i = least;
+            child = (ptrdiff_t)i * D + 1;
+        }
+        m_position[e.handle] = i;
+        node[i] = std::move(e);
+    }
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+/** mergeSort first sorts runs of this many elements, or half as
+    many, with insertionSort */
+static const int mergeSortRun = 32;
+
+namespace _internal {
+
+/** Moves the merge of [a, aEnd) and [b, bEnd) to out, taking from
+    [a, aEnd) on ties */
+template<class In, class Out, class KeyOf, class Less>
+void mergeInto(In a, In aEnd, In b, In bEnd, Out out, KeyOf& keyOf, Less& less) {
+    SortInstrument::moved((aEnd - a) + (bEnd - b));
+    while ((a != aEnd) && (b != bEnd)) {
+        if (compareKeys(less, keyOf(*b), keyOf(*a)))
+            *out++ = std::move(*b++);
+        else
+            *out++ = std::move(*a++);
+    }
+    out = std::move(a, aEnd, out);
+    std::move(b, bEnd, out);
+}
+
+/** Merges each pair of adjacent runs of width elements from src to
+    the same place in dst */
+template<class In, class Out, class KeyOf, class Less>
+void mergePass(In src, Out dst, const ptrdiff_t N, const ptrdiff_t width, KeyOf& keyOf, Less& less) {
+    for (ptrdiff_t low = 0; low < N; low += 2 * width) {
+        const ptrdiff_t mid  = std::min(low + width, N);
+        const ptrdiff_t high = std::min(low + 2 * width, N);
+        mergeInto(src + low, src + mid, src + mid, src + high, dst + low, keyOf, less);
+    }
+}
+
+/** Number of merge passes after sorting runs of this length */
+inline int mergePasses(const ptrdiff_t N, const ptrdiff_t run) {
+    int passes = 0;
+    for (ptrdiff_t width = run; width < N; width *= 2) {
+        ++passes;
+    }
+    return passes;
+}
+
+/** Sorts runs of data[0, N) with insertionSort and merges them
+    bottom-up, each pass from one buffer to the other.  The result is
+    in other after an odd number of passes, else in data. */
+template<class A, class B, class KeyOf, class Less>
+void mergeSortRuns(A data, B other, const ptrdiff_t N, const ptrdiff_t run, KeyOf& keyOf, Less& less) {
+    for (ptrdiff_t low = 0; low < N; low += run) {
+        insertionSort(data + low, data + std::min(low + run, N), keyOf, less);
+    }
+
+    ptrdiff_t width = run;
+    while (width < N) {
+        mergePass(data, other, N, width, keyOf, less);
+        width *= 2;
+        if (width >= N) break;
+
+        mergePass(other, data, N, width, keyOf, less);
+        width *= 2;
+    }
+}
+
+/** Sorts the runs in place, with a length chosen so that the number
+    of passes is even and the result ends in place.  The scratch
+    holds N elements, constructed unless trivially copyable. */
+template<class Iterator, class T, class KeyOf, class Less>
+void mergeSortWith(Iterator first, T* scratch, const ptrdiff_t N, KeyOf& keyOf, Less& less) {
+    const ptrdiff_t run = (mergePasses(N, mergeSortRun) % 2 == 0) ? mergeSortRun : mergeSortRun / 2;
+    mergeSortRuns(first, scratch, N, run, keyOf, less);
+}
+
+/** Trivially copyable elements, in an array or any other random
+    access range, use the thread's SortArena */
+template<class Iterator, class KeyOf, class Less>
+void mergeSort(Iterator first, Iterator last, KeyOf& keyOf, Less& less, std::true_type) {
+    typedef typename std::iterator_traits<Iterator>::value_type T;
+    mergeSortWith(first, Scratch<T>(last - first).data(), last - first, keyOf, less);
+}
+
+/** Other elements are moved into a buffer to construct it, which is
+    where the runs are sorted; their length is chosen so that the
+    number of passes is odd and the result ends in place */
+template<class Iterator, class KeyOf, class Less>
+void mergeSort(Iterator first, Iterator last, KeyOf& keyOf, Less& less, std::false_type) {
+    const ptrdiff_t N = last - first;
+    const ptrdiff_t run = (mergePasses(N, mergeSortRun) % 2 == 1) ? mergeSortRun : mergeSortRun / 2;
+
+    std::vector<typename std::iterator_traits<Iterator>::value_type> temp(std::make_move_iterator(first), std::make_move_iterator(last));
+    SortInstrument::moved(N);
+    mergeSortRuns(temp.begin(), first, N, run, keyOf, less);
+}
+
+template<class Iterator, class KeyOf, class Less>
+void mergeSort(Iterator first, Iterator last, KeyOf& keyOf, Less& less) {
+    typedef typename std::iterator_traits<Iterator>::value_type T;
+    mergeSort(first, last, keyOf, less, std::integral_constant<bool, std::is_trivially_copyable<T>::value>());
+}
+
+} // namespace _internal
+
+/** Stable: elements with equal keys keep their order.  Bottom-up:
+    runs are sorted with insertionSort and then merged in passes that
+    alternate between the range and a scratch buffer of the same
+    size. */
+template<class Iterator, class KeyOf, class Less>
+void mergeSort(Iterator first, Iterator last, KeyOf keyOf, Less less) {
+    if (last - first <= mergeSortRun) {
+        insertionSort(first, last, keyOf, less);
+    } else {
+        _internal::mergeSort(first, last, keyOf, less);
+    }
+}
+
+/** mergeSort through the caller's scratch, which has room for
+    last - first elements (constructed, if they are not trivially
+    copyable).  Does not allocate. */
+template<class Iterator, class KeyOf, class Less>
+void mergeSort(Iterator first, Iterator last, KeyOf keyOf, Less less, typename std::iterator_traits<Iterator>::value_type* scratch) {
+    if (last - first <= mergeSortRun) {
+        insertionSort(first, last, keyOf, less);
+    } else {
+        _internal::mergeSortWith(first, scratch, last - first, keyOf, less);
+    }
+}
+
+template<class Iterator, class KeyOf>
+void mergeSort(Iterator first, Iterator last, KeyOf keyOf) {
+    mergeSort(first, last, keyOf, KeyLess());
+}
+
+template<class Iterator>
+void mergeSort(Iterator first, Iterator last) {
+    mergeSort(first, last, SelfKey(), KeyLess());
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// powerSort is a stable merge sort that follows the runs already in
+// the input, for input that is nearly sorted, such as last frame's
+// order after a few changes.  It is Munro and Wild's powersort:
+// Timsort's run detection and galloping merges, with the order of
+// merges chosen by the midpoints of the runs, which keeps them nearly
+// balanced.
+
+/** Runs shorter than this are extended with insertionSort before
+    merging */
+static const int powerSortMinRun = 24;
+
+/** A merge switches from taking one element at a time to galloping
+    after this many in a row came from the same side */
+static const int powerSortGallop = 7;
+
+namespace _internal {
+
+/** Holds the shorter run of a merge: in the thread's SortArena when the
+    elements are trivially copyable, else in a vector that the run is
+    moved into */
+template<class T, bool trivial = std::is_trivially_copyable<T>::value>
+class RunBuffer {
+public:
+    explicit RunBuffer(size_t N) : m_data((T*)SortArena::local().reserve(N * sizeof(T))) {}
+
+    template<class Iterator>
+    T* fill(Iterator first, Iterator last) {
+        std::copy(first, last, m_data);
+        return m_data;
+    }
+
+private:
+    T* m_data;
+};
+
+template<class T>
+class RunBuffer<T, false> {
+public:
+    explicit RunBuffer(size_t N) {
+        m_data.reserve(N);
+    }
+
+    template<class Iterator>
+    T* fill(Iterator first, Iterator last) {
+        m_data.clear();
+        m_data.insert(m_data.end(), std::make_move_iterator(first), std::make_move_iterator(last));
+        return m_data.data();
+    }
+
+private:
+    std::vector<T> m_data;
+};
+
+/** The number of leading elements of first[0, n) for which pred
+    holds, given that it holds for some prefix and then never again.
+    Tries 1, 2, 4, ... elements from the front, or from the back,
+    before a binary search, so it is fast when the answer is near
+    that end. */
+template<class Iterator, class Pred>
+ptrdiff_t gallop(Iterator first, const ptrdiff_t n, Pred pred, const bool fromBack) {
+    ptrdiff_t lo = 0;
+    ptrdiff_t hi = n;
+
+    if (fromBack) {
+        for (ptrdiff_t d = 0; d < n; d = 2 * d + 1) {
+            if (pred(first[n - 1 - d])) {
+                lo = n - d;
+                break;
+            }
+            hi = n - 1 - d;
+        }
+    } else {
+        for (ptrdiff_t d = 0; d < n; d = 2 * d + 1) {
+            if (! pred(first[d])) {
+                hi = d;
+                break;
+            }
+            lo = d + 1;
+        }
+    }
+
+    while (lo < hi) {
+        const ptrdiff_t mid = lo + (hi - lo) / 2;
+        if (pred(first[mid])) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/** Merges a[0, aN), which has been moved out of the range, with the
+    following run [b, bEnd) into [out, bEnd), taking from a on ties */
+template<class T, class Iterator, class KeyOf, class Less>
+void mergeLow(T* a, T* const aEnd, Iterator b, const Iterator bEnd, Iterator out, KeyOf& keyOf, Less& less) {
+    typedef typename PivotKey<KeyOf, T>::type Key;
+
+    while ((a != aEnd) && (b != bEnd)) {
+        // One at a time, until one side wins several in a row
+        int aWins = 0;
+        int bWins = 0;
+        do {
+            if (less(keyOf(*b), keyOf(*a))) {
+                *out++ = std::move(*b++);
+                ++bWins;
+                aWins = 0;
+            } else {
+                *out++ = std::move(*a++);
+                ++aWins;
+                bWins = 0;
+            }
+        } while ((a != aEnd) && (b != bEnd) && (aWins < powerSortGallop) && (bWins < powerSortGallop));
+
+        // Then move whole blocks, for as long as they stay long
+        while ((a != aEnd) && (b != bEnd)) {
+            Key bKey = keyOf(*b);
+            const ptrdiff_t na = gallop(a, aEnd - a, [&](const T& x) { return ! less(bKey, keyOf(x)); }, false);
+            out = std::move(a, a + na, out);
+            a += na;
+            if (a == aEnd) break;
+
+            Key aKey = keyOf(*a);
+            const ptrdiff_t nb = gallop(b, bEnd - b, [&](const T& x) { return less(keyOf(x), aKey); }, false);
+            out = std::move(b, b + nb, out);
+            b += nb;
+
+            if ((na < powerSortGallop) && (nb < powerSortGallop)) break;
+        }
+    }
+
+    // Anything left in b is already in place
+    std::move(a, aEnd, out);
+}
+
+/** Merges the run [a, aEnd) with b[0, bN), which followed it and has
+    been moved out of the range, filling the range from its end, which
+    is outEnd.  Takes from a on ties. */
+template<class T, class Iterator, class KeyOf, class Less>
+void mergeHigh(const Iterator a, Iterator aEnd, T* b, T* bEnd, Iterator outEnd, KeyOf& keyOf, Less& less) {
+    typedef typename PivotKey<KeyOf, T>::type Key;
+
+    while ((a != aEnd) && (b != bEnd)) {
+        int aWins = 0;
+        int bWins = 0;
+        do {
+            if (less(keyOf(bEnd[-1]), keyOf(aEnd[-1]))) {
+                *--outEnd = std::move(*--aEnd);
+                ++aWins;
+                bWins = 0;
+            } else {
+                *--outEnd = std::move(*--bEnd);
+                ++bWins;
+                aWins = 0;
+            }
+        } while ((a != aEnd) && (b != bEnd) && (aWins < powerSortGallop) && (bWins < powerSortGallop));
+
+        while ((a != aEnd) && (b != bEnd)) {
+            Key bKey = keyOf(bEnd[-1]);
+            const ptrdiff_t na = (aEnd - a) - gallop(a, aEnd - a, [&](const T& x) { return ! less(bKey, keyOf(x)); }, true);
+            outEnd = std::move_backward(aEnd - na, aEnd, outEnd);
+            aEnd -= na;
+            if (a == aEnd) break;
+
+            Key aKey = keyOf(aEnd[-1]);
+            const ptrdiff_t nb = (bEnd - b) - gallop(b, bEnd - b, [&](const T& x) { return less(keyOf(x), aKey); }, true);
+            outEnd = std::move_backward(bEnd - nb, bEnd, outEnd);
+            bEnd -= nb;
+
+            if ((na < powerSortGallop) && (nb < powerSortGallop)) break;
+        }
+    }
+
+    // Anything left in a is already in place
+    std::move_backward(b, bEnd, outEnd);
+}
+
+/** Merges the adjacent sorted runs [first, mid) and [mid, last),
+    moving the shorter one out to buffer */
+template<class Iterator, class Buffer, class KeyOf, class Less>
+void mergeAdjacent(Iterator first, Iterator mid, Iterator last, Buffer& buffer, KeyOf& keyOf, Less& less) {
+    typedef typename std::iterator_traits<Iterator>::value_type T;
+
+    // Elements of the first run not greater than the start of the
+    // second, and of the second run not less than the end of the
+    // first, are already in place.  For runs that are already in
+    // order, this is the whole merge.
+    {
+        typename PivotKey<KeyOf, T>::type key = keyOf(*mid);
+        first += gallop(first, mid - first, [&](const T& x) { return ! less(key, keyOf(x)); }, false);
+    }
+    if (first == mid) return;
+    {
+        typename PivotKey<KeyOf, T>::type key = keyOf(mid[-1]);
+        last = mid + gallop(mid, last - mid, [&](const T& x) { return less(keyOf(x), key); }, true);
+    }
+
+    if (mid - first <= last - mid) {
+        T* a = buffer.fill(first, mid);
+        mergeLow(a, a + (mid - first), mid, last, first, keyOf, less);
+    } else {
+        T* b = buffer.fill(mid, last);
+        mergeHigh(first, mid, b, b + (last - mid), last, keyOf, less);
+    }
+}
+
+/** The end of the run that starts at first, which is reversed if it
+    is strictly descending (so that equal elements keep their order),
+    and extended to at least powerSortMinRun elements */
+template<class Iterator, class KeyOf, class Less>
+Iterator nextRun(Iterator first, Iterator last, KeyOf& keyOf, Less& less) {
+    Iterator end = first + 1;
+    if (end == last) return end;
+
+    if (less(keyOf(*end), keyOf(*first))) {
+        while ((++end != last) && less(keyOf(*end), keyOf(end[-1])));
+        std::reverse(first, end);
+    } else {
+        while ((++end != last) && ! less(keyOf(*end), keyOf(end[-1])));
+    }
+
+    if (end - first < powerSortMinRun) {
+        // insertionSort passes over the sorted prefix quickly
+        end = first + std::min<ptrdiff_t>(powerSortMinRun, last - first);
+        insertionSort(first, end, keyOf, less);
+    }
+    return end;
+}
+
+/** The depth in a perfectly balanced merge tree over [0, N) at which
+    the boundary between adjacent runs [begin1, begin2) and
+    [begin2, end2) would fall: the first bit at which the binary
+    fractions of their midpoints, as fractions of N, differ */
+inline int nodePower(const size_t N, const size_t begin1, const size_t begin2, const size_t end2) {
+    // The midpoints, in units of 1 / (2N)
+    uint64_t a = (uint64_t)begin1 + begin2;
+    uint64_t b = (uint64_t)begin2 + end2;
+    int power = 0;
+    while (true) {
+        ++power;
+        if (a >= N) {
+            a -= N;
+            b -= N;
+        } else if (b >= N) {
+            return power;
+        }
+        a *= 2;
+        b *= 2;
+    }
+}
+
+} // namespace _internal
+
+/** Stable, and O(N) time when the input is sorted, reverse sorted, or
+    made of a few sorted runs; O(N log N) otherwise.  Uses at most
+    N / 2 elements of scratch. */
+template<class Iterator, class KeyOf, class Less>
+void powerSort(Iterator first, Iterator last, KeyOf keyOf, Less less) {
+    typedef typename std::iterator_traits<Iterator>::value_type T;
+    const size_t N = last - first;
+    if (N < 2) return;
+
+    // Runs waiting to be merged, with the power of the boundary after
+    // each; the powers increase up the stack, so there are at most
+    // log2(N) + 1 of them
+    struct Run {
+        Iterator begin;
+        int      power;
+    };
+    Run stack[66];
+    int top = 0;
+
+    _internal::RunBuffer<T> buffer(N / 2);
+
+    Iterator begin = first;
+    Iterator end = _internal::nextRun(begin, last, keyOf, less);
+    while (end != last) {
+        const Iterator nextEnd = _internal::nextRun(end, last, keyOf, less);
+        const int power = _internal::nodePower(N, begin - first, end - first, nextEnd - first);
+
+        while ((top > 0) && (stack[top - 1].power > power)) {
+            --top;
+            _internal::mergeAdjacent(stack[top].begin, begin, end, buffer, keyOf, less);
+            begin = stack[top].begin;
+        }
+
+        stack[top].begin = begin;
+        stack[top].power = power;
+        ++top;
+
+        begin = end;
+        end = nextEnd;
+    }
+
+    while (top > 0) {
+        --top;
+        _internal::mergeAdjacent(stack[top].begin, begin, last, buffer, keyOf, less);
+        begin = stack[top].begin;
+    }
+}
+
+template<class Iterator, class KeyOf>
+void powerSort(Iterator first, Iterator last, KeyOf keyOf) {
+    powerSort(first, last, keyOf, KeyLess());
+}
+
+template<class Iterator>
+void powerSort(Iterator first, Iterator last) {
+    powerSort(first, last, SelfKey(), KeyLess());
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Sorting networks for 4, 8, 16, or 32 float keys, each with a 32-bit
+// index that moves with it.  These are bitonic sorts: a fixed sequence
+// of compare-exchanges with no branches on the keys, which with AVX2
+// (8 keys to a register) or SSE4.1 (4) are made for a whole register
+// at once, and otherwise one pair at a time.  They are not stable.
+
+namespace _internal {
+
+/** True if, in the bitonic stage that compares element i with i ^ j
+    while building sorted runs of k, element i takes the minimum */
+inline constexpr bool bitonicTakesMin(int i, int k, int j) {
+    return ((i & k) == 0) == ((i & j) == 0);
+}
+
+/** Bit l set if element i + l takes the minimum, for l in [lane, width) */
+inline constexpr int bitonicLaneBits(int i, int lane, int width, int k, int j) {
+    return (lane == width) ? 0 :
+        ((bitonicTakesMin(i + lane, k, j) ? (1 << lane) : 0) | bitonicLaneBits(i, lane + 1, width, k, j));
+}
+
+template<int N>
+void scalarSortKeys(float* key, uint32_t* index) {
+    for (int k = 2; k <= N; k *= 2) {
+        for (int j = k / 2; j > 0; j /= 2) {
+            for (int i = 0; i < N; ++i) {
+                const int p = i ^ j;
+                if ((p > i) && (bitonicTakesMin(i, k, j) ? (key[p] < key[i]) : (key[i] < key[p]))) {
+                    std::swap(key[i], key[p]);
+                    std::swap(index[i], index[p]);
+                }
+            }
+        }
+    }
+}
+
+#if defined(__SSE4_1__)
+
+/** Four lanes of SSE4.1.  Indices are carried in float registers. */
+struct NetSse {
+    typedef __m128 Vector;
+    static const int width = 4;
+
+    static Vector load(const float* p)       { return _mm_loadu_ps(p); }
+    static Vector load(const uint32_t* p)    { return _mm_castsi128_ps(_mm_loadu_si128((const __m128i*)p)); }
+    static void store(float* p, Vector v)    { _mm_storeu_ps(p, v); }
+    static void store(uint32_t* p, Vector v) { _mm_storeu_si128((__m128i*)p, _mm_castps_si128(v)); }
+
+    static Vector less(Vector a, Vector b)   { return _mm_cmplt_ps(a, b); }
+
+    /** b in the lanes where mask is set, else a */
+    static Vector select(Vector a, Vector b, Vector mask) { return _mm_blendv_ps(a, b, mask); }
+
+    /** Lane l set where bit l is */
+    static Vector fromBits(int bits) {
+        return _mm_castsi128_ps(_mm_setr_epi32(-(bits & 1), -((bits >> 1) & 1), -((bits >> 2) & 1), -((bits >> 3) & 1)));
+    }
+
+    /** Lane l of v ^ j */
+    template<int j>
+    static Vector partner(Vector v) {
+        return _mm_shuffle_ps(v, v, (j == 1) ? _MM_SHUFFLE(2, 3, 0, 1) : _MM_SHUFFLE(1, 0, 3, 2));
+    }
+};
+
+#endif
+#if defined(__AVX2__)
+
+/** Eight lanes of AVX2 */
+struct NetAvx {
+    typedef __m256 Vector;
+    static const int width = 8;
+
+    static Vector load(const float* p)       { return _mm256_loadu_ps(p); }
+    static Vector load(const uint32_t* p)    { return _mm256_castsi256_ps(_mm256_loadu_si256((const __m256i*)p)); }
+    static void store(float* p, Vector v)    { _mm256_storeu_ps(p, v); }
+    static void store(uint32_t* p, Vector v) { _mm256_storeu_si256((__m256i*)p, _mm256_castps_si256(v)); }
+
+    static Vector less(Vector a, Vector b)   { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+
+    static Vector select(Vector a, Vector b, Vector mask) { return _mm256_blendv_ps(a, b, mask); }
+
+    static Vector fromBits(int bits) {
+        return _mm256_castsi256_ps(_mm256_setr_epi32(-(bits & 1), -((bits >> 1) & 1), -((bits >> 2) & 1), -((bits >> 3) & 1),
+                                                     -((bits >> 4) & 1), -((bits >> 5) & 1), -((bits >> 6) & 1), -((bits >> 7) & 1)));
+    }
+
+    template<int j>
+    static Vector partner(Vector v) {
+        return (j == 4) ? _mm256_permute2f128_ps(v, v, 1) :
+            _mm256_permute_ps(v, (j == 1) ? _MM_SHUFFLE(2, 3, 0, 1) : _MM_SHUFFLE(1, 0, 3, 2));
+    }
+};
+
+#endif
+
+/** One bitonic stage on N keys in registers of V::width lanes */
+template<class V, int N, int k, int j>
+inline void bitonicStage(typename V::Vector* key, typename V::Vector* index) {
+    typedef typename V::Vector Vector;
+    static const int R = N / V::width;
+
+    if (j >= V::width) {
+        // Partners are in the same lane of another register
+        static const int d = (j >= V::width) ? j / V::width : 1;
+        for (int r = 0; r < R; ++r) {
+            if (r & d) continue;
+            const int u = r | d;
+            const Vector exchange = (((r * V::width) & k) == 0) ? V::less(key[u], key[r]) : V::less(key[r], key[u]);
+
+            const Vector k0 = key[r];
+            const Vector i0 = index[r];
+            key[r]   = V::select(k0, key[u], exchange);
+            key[u]   = V::select(key[u], k0, exchange);
+            index[r] = V::select(i0, index[u], exchange);
+            index[u] = V::select(index[u], i0, exchange);
+        }
+    } else {
+        // Partners are in the same register.  Which lanes take the
+        // minimum depends on the register only through bit k.
+        static const int ascending  = bitonicLaneBits(0, 0, V::width, k, j);
+        static const int descending = bitonicLaneBits(k, 0, V::width, k, j);
+        for (int r = 0; r < R; ++r) {
+            const Vector takesMin = V::fromBits(((r * V::width) & k) ? descending : ascending);
+            const Vector pk = V::template partner<j>(key[r]);
+            const Vector pi = V::template partner<j>(index[r]);
+            const Vector take = V::select(V::less(key[r], pk), V::less(pk, key[r]), takesMin);
+            key[r]   = V::select(key[r], pk, take);
+            index[r] = V::select(index[r], pi, take);
+        }
+    }
+}
+
+/** The stages from (k, j) on, each a separate instantiation so that
+    every lane mask and shuffle is a constant */
+template<class V, int N, int k, int j, bool done = (k > N)>
+struct BitonicStages {
+    static void run(typename V::Vector* key, typename V::Vector* index) {
+        bitonicStage<V, N, k, j>(key, index);
+        BitonicStages<V, N, (j == 1) ? 2 * k : k, (j == 1) ? k : j / 2>::run(key, index);
+    }
+};
+
+template<class V, int N, int k, int j>
+struct BitonicStages<V, N, k, j, true> {
+    static void run(typename V::Vector*, typename V::Vector*) {}
+};
+
+template<class V, int N>
+void simdSortKeys(float* key, uint32_t* index) {
+    static const int R = N / V::width;
+    typename V::Vector k[R];
+    typename V::Vector i[R];
+
+    for (int r = 0; r < R; ++r) {
+        k[r] = V::load(key + r * V::width);
+        i[r] = V::load(index + r * V::width);
+    }
+
+    BitonicStages<V, N, 2, 1>::run(k, i);
+
+    for (int r = 0; r < R; ++r) {
+        V::store(key + r * V::width, k[r]);
+        V::store(index + r * V::width, i[r]);
+    }
+}
+
+} // namespace _internal
+
+/** Sorts N = 4, 8, 16, or 32 float keys from least to greatest,
+    applying the same exchanges to index[0, N) */
+template<int N>
+void sortKeys(float* key, uint32_t* index) {
+    static_assert((N == 4) || (N == 8) || (N == 16) || (N == 32), "sortKeys is for 4, 8, 16, or 32 keys");
+#if defined(__AVX2__)
+    _internal::simdSortKeys<typename std::conditional<(N >= 8), _internal::NetAvx, _internal::NetSse>::type, N>(key, index);
+#elif defined(__SSE4_1__)
+    _internal::simdSortKeys<_internal::NetSse, N>(key, index);
+#else
+    _internal::scalarSortKeys<N>(key, index);
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// sortNetwork<N> sorts exactly N elements with Batcher's odd-even
+// merge sort, generated at compile time: for the next power of two
+// above N, less the comparators that involve elements past N (which
+// would hold infinities, and never be exchanged).  That is optimal
+// for N <= 8, and within a few comparators of the best known
+// networks up to 32 (63 rather than 60 for 16).  Every
+// compare-exchange has constant indices, so the whole sort is
+// straight-line code.
+
+namespace _internal {
+
+inline constexpr int networkSize(int N, int size = 1) {
+    return (size >= N) ? size : networkSize(N, 2 * size);
+}
+
+/** Exchanges the words of x and y where mask is set, unrolled */
+template<class Word, int words>
+struct MaskedExchange {
+    static void run(Word* x, Word* y, Word mask) {
+        const Word d = (x[words - 1] ^ y[words - 1]) & mask;
+        x[words - 1] ^= d;
+        y[words - 1] ^= d;
+        MaskedExchange<Word, words - 1>::run(x, y, mask);
+    }
+};
+
+template<class Word>
+struct MaskedExchange<Word, 0> {
+    static void run(Word*, Word*, Word) {}
+};
+
+/** Orders a and b, without branching on their keys where possible:
+    floating-point numbers that are their own keys with min and max
+    instructions, and other
+    trivially copyable elements with a masked exchange of their
+    words.  Compilers otherwise tend to turn a select of whole
+    elements back into a branch. */
+template<class T, class KeyOf, class Less>
+inline void compareExchange(T& a, T& b, KeyOf& keyOf, Less& less, std::integral_constant<int, 0>) {
+    using std::swap;
+    if (less(keyOf(b), keyOf(a))) swap(a, b);
+}
+
+template<class T, class KeyOf, class Less>
+inline void compareExchange(T& a, T& b, KeyOf&, Less&, std::integral_constant<int, 1>) {
+    const T lo = std::min(a, b);
+    const T hi = std::max(a, b);
+    a = lo;
+    b = hi;
+}
+
+template<class T, class KeyOf, class Less>
+inline void compareExchange(T& a, T& b, KeyOf& keyOf, Less& less, std::integral_constant<int, 2>) {
+    typedef typename std::conditional<sizeof(T) % sizeof(uint64_t) == 0, uint64_t, uint32_t>::type Word;
+    static const int words = sizeof(T) / sizeof(Word);
+
+    const Word mask = -(Word)less(keyOf(b), keyOf(a));
+    Word x[words];
+    Word y[words];
+    memcpy(x, &a, sizeof(T));
+    memcpy(y, &b, sizeof(T));
+    MaskedExchange<Word, words>::run(x, y, mask);
+    memcpy(&a, x, sizeof(T));
+    memcpy(&b, y, sizeof(T));
+}
+
+/** Which compareExchange: 1 for min and max, 2 for the masked
+    exchange, else 0 */
+template<class T, class KeyOf, class Less>
+struct ExchangeKind {
+    static const int value =
+        (std::is_floating_point<T>::value && std::is_same<KeyOf, SelfKey>::value && std::is_same<Less, KeyLess>::value) ? 1 :
+        (std::is_trivially_copyable<T>::value && (sizeof(T) % sizeof(uint32_t) == 0)) ? 2 : 0;
+};
+
+template<int N, int i, int j, bool inside = (j < N)>
+struct NetworkComparator {
+    template<class T, class KeyOf, class Less>
+    static void run(T* e, KeyOf& keyOf, Less& less) {
+        compareExchange(e[i], e[j], keyOf, less, std::integral_constant<int, ExchangeKind<T, KeyOf, Less>::value>());
+    }
+};
+
+template<int N, int i, int j>
+struct NetworkComparator<N, i, j, false> {
+    template<class T, class KeyOf, class Less>
+    static void run(T*, KeyOf&, Less&) {}
+};
+
+/** Compares i with i + r for i = first, first + step, ... while
+    i + r < end */
+template<int N, int i, int end, int r, int step, bool more = (i + r < end)>
+struct NetworkComparators {
+    template<class T, class KeyOf, class Less>
+    static void run(T* e, KeyOf& keyOf, Less& less) {
+        NetworkComparator<N, i, i + r>::run(e, keyOf, less);
+        NetworkComparators<N, i + step, end, r, step>::run(e, keyOf, less);
+    }
+};
+
+template<int N, int i, int end, int r, int step>
+struct NetworkComparators<N, i, end, r, step, false> {
+    template<class T, class KeyOf, class Less>
+    static void run(T*, KeyOf&, Less&) {}
+};
+
+/** Merges the elements of [low, low + n) that are r apart */
+template<int N, int low, int n, int r, bool split = (2 * r < n)>
+struct NetworkMerge {
+    template<class T, class KeyOf, class Less>
+    static void run(T* e, KeyOf& keyOf, Less& less) {
+        NetworkMerge<N, low, n, 2 * r>::run(e, keyOf, less);
+        NetworkMerge<N, low + r, n, 2 * r>::run(e, keyOf, less);
+        NetworkComparators<N, low + r, low + n, r, 2 * r>::run(e, keyOf, less);
+    }
+};
+
+template<int N, int low, int n, int r>
+struct NetworkMerge<N, low, n, r, false> {
+    template<class T, class KeyOf, class Less>
+    static void run(T* e, KeyOf& keyOf, Less& less) {
+        NetworkComparator<N, low, low + r>::run(e, keyOf, less);
+    }
+};
+
+/** Sorts [low, low + n), for n a power of two, unless it is all
+    past N */
+template<int N, int low, int n, bool work = (n > 1) && (low < N)>
+struct NetworkSort {
+    template<class T, class KeyOf, class Less>
+    static void run(T* e, KeyOf& keyOf, Less& less) {
+        NetworkSort<N, low, n / 2>::run(e, keyOf, less);
+        NetworkSort<N, low + n / 2, n / 2>::run(e, keyOf, less);
+        NetworkMerge<N, low, n, 1>::run(e, keyOf, less);
+    }
+};
+
+template<int N, int low, int n>
+struct NetworkSort<N, low, n, false> {
+    template<class T, class KeyOf, class Less>
+    static void run(T*, KeyOf&, Less&) {}
+};
+
+} // namespace _internal
+
+/** Sorts element[0, N), for N known at compile time, with a sorting
+    network.  Not stable. */
+template<int N, class T, class KeyOf, class Less>
+void sortNetwork(T* element, KeyOf keyOf, Less less) {
+    static_assert((N >= 0) && (N <= 64), "sortNetwork is for up to 64 elements");
+    _internal::NetworkSort<N, 0, _internal::networkSize(N)>::run(element, keyOf, less);
+}
+
+template<int N, class T, class KeyOf>
+void sortNetwork(T* element, KeyOf keyOf) {
+    sortNetwork<N>(element, keyOf, KeyLess());
+}
+
+template<int N, class T>
+void sortNetwork(T* element) {
+    sortNetwork<N>(element, SelfKey(), KeyLess());
+}
+
+namespace _internal {
+
+/** Partitions of up to quickSortCutoff elements are finished by
+    insertionSort, except arrays of small trivially copyable elements
+    with float keys in the default order, when there is SIMD support
+    for sortKeys.  Their keys are sorted in a network, padded with
+    infinities, and the elements then put in that order. */
+template<class Iterator, class KeyOf, class Less>
+inline void finishPartition(Iterator first, Iterator last, KeyOf& keyOf, Less& less, std::false_type) {
+    insertionSort(first, last, keyOf, less);
+}
+
+template<class T, class KeyOf, class Less>
+void finishPartition(T* first, T* last, KeyOf& keyOf, Less&, std::true_type) {
+    const int n = (int)(last - first);
+    if (n < 2) return;
+
+    float    key[32];
+    uint32_t index[32];
+    const int size = (n <= 4) ? 4 : (n <= 8) ? 8 : (n <= 16) ? 16 : 32;
+    for (int i = 0; i < size; ++i) {
+        key[i]   = (i < n) ? (float)keyOf(first[i]) : HUGE_VALF;
+        index[i] = i;
+    }
+
+    switch (size) {
+    case 4:  sortKeys<4>(key, index);  break;
+    case 8:  sortKeys<8>(key, index);  break;
+    case 16: sortKeys<16>(key, index); break;
+    default: sortKeys<32>(key, index); break;
+    }
+
+    // The padding may tie with infinite keys, so it is skipped
+    // wherever it landed
+    typename std::aligned_storage<sizeof(T) * 32, alignof(T)>::type buffer;
+    T* temp = (T*)&buffer;
+    memcpy(temp, first, n * sizeof(T));
+    T* out = first;
+    for (int i = 0; i < size; ++i) {
+        if (index[i] < (uint32_t)n) {
+            memcpy(out++, temp + index[i], sizeof(T));
+        }
+    }
+}
+
+/** Whether finishPartition may use sortKeys.  Not when instrumented,
+    since the network's comparisons are not calls to less. */
+template<class Iterator, class KeyOf, class Less>
+struct UseNetwork {
+    typedef typename std::iterator_traits<Iterator>::value_type T;
+    typedef typename std::decay<decltype(std::declval<KeyOf&>()(std::declval<const T&>()))>::type Key;
+    static const bool value =
+#if defined(__SSE4_1__)
+        std::is_pointer<Iterator>::value && std::is_trivially_copyable<T>::value && (sizeof(T) <= 16) &&
+        std::is_same<Key, float>::value && std::is_same<Less, KeyLess>::value && ! SortInstrument::enabled;
+#else
+        false;
+#endif
+};
+
+template<class Iterator, class KeyOf, class Less>
+inline void finishPartition(Iterator first, Iterator last, KeyOf& keyOf, Less& less) {
+    finishPartition(first, last, keyOf, less, std::integral_constant<bool, UseNetwork<Iterator, KeyOf, Less>::value>());
+}
+
+} // namespace _internal
+
+///////////////////////////////////////////////////////////////////////////////
+
+namespace _internal {
+
+/** Partitions [first, last), of more than two elements, around a
+    pivot chosen by choosePivot.  Returns the pivot's final position;
+    keys before it are not greater and keys after it not less. */
+template<class Iterator, class KeyOf, class Less>
+Iterator partitionAroundPivot(Iterator first, Iterator last, KeyOf& keyOf, Less& less) {
+    // The pivot stays at first until the end, so its key may be
+    // referenced in place.
+    swapElements(first, choosePivot(first, last - first, keyOf, less));
+    typename PivotKey<KeyOf, typename std::iterator_traits<Iterator>::value_type>::type pivot = keyOf(*first);
+    Iterator i = first;
+    Iterator j = last;
+
+    while (true) {
+        while ((++i < last) && compareKeys(less, keyOf(*i), pivot));
+        while (compareKeys(less, pivot, keyOf(*--j)));
+
+        if (i >= j) break;
+
+        swapElements(i, j);
+    }
+
+    swapElements(i - 1, first);
+    return i - 1;
+}
+
+/** blockPartition compares this many elements at a time from each end */
+static const int partitionBlock = 64;
+
+/** partitionAroundPivot without branches on the comparisons, after
+    Edelkamp and Weiss's BlockQuicksort.  It compares a block of
+    elements from each end, recording the offsets of those on the
+    wrong side with a branch-free increment, and then swaps the
+    recorded pairs.  Random keys no longer cause a branch
+    misprediction for every other element. */
+template<class Iterator, class KeyOf, class Less>
+Iterator blockPartition(Iterator first, Iterator last, KeyOf& keyOf, Less& less) {
+    swapElements(first, choosePivot(first, last - first, keyOf, less));
+    typename PivotKey<KeyOf, typename std::iterator_traits<Iterator>::value_type>::type pivot = keyOf(*first);
+
+    // [l, r) has not been compared yet.  offsetL holds the offsets from
+    // baseL of the elements in the left block that are not less than
+    // the pivot, and offsetR the offsets back from baseR of those in
+    // the right block that are not greater.  As in
+    // partitionAroundPivot, keys equal to the pivot are swapped from
+    // both sides, so that repeated keys split evenly.
+    Iterator l = first + 1;
+    Iterator r = last;
+    Iterator baseL = l;
+    Iterator baseR = r;
+    unsigned char offsetL[partitionBlock];
+    unsigned char offsetR[partitionBlock];
+    int startL = 0, numL = 0;
+    int startR = 0, numR = 0;
+
+    while (l < r) {
+        // Start a block at each end that has nothing left to swap.
+        // Near the middle, the blocks share what remains.
+        const ptrdiff_t unknown = r - l;
+        const ptrdiff_t sizeL = std::min<ptrdiff_t>(partitionBlock, (numL > 0) ? 0 : ((numR > 0) ? unknown : unknown / 2));
+        const ptrdiff_t sizeR = std::min<ptrdiff_t>(partitionBlock, (numR > 0) ? 0 : unknown - sizeL);
+
+        for (int i = 0; i < sizeL; ++i, ++l) {
+            offsetL[numL] = (unsigned char)i;
+            numL += ! compareKeys(less, keyOf(*l), pivot);
+        }
+        for (int i = 1; i <= sizeR; ++i) {
+            offsetR[numR] = (unsigned char)i;
+            numR += ! compareKeys(less, pivot, keyOf(*--r));
+        }
+
+        const int n = std::min(numL, numR);
+        for (int i = 0; i < n; ++i) {
+            swapElements(baseL + offsetL[startL + i], baseR - offsetR[startR + i]);
+        }
+        numL -= n;
+        numR -= n;
+        startL += n;
+        startR += n;
+
+        if (numL == 0) {
+            startL = 0;
+            baseL = l;
+        }
+        if (numR == 0) {
+            startR = 0;
+            baseR = r;
+        }
+    }
+
+    // One block may have elements left on the wrong side, which are
+    // moved to the middle, beside the other side
+    while (numL > 0) {
+        --numL;
+        swapElements(baseL + offsetL[startL + numL], --r);
+    }
+    while (numR > 0) {
+        --numR;
+        swapElements(baseR - offsetR[startR + numR], r++);
+    }
+
+    swapElements(r - 1, first);
+    return r - 1;
+}
+
+} // namespace _internal
+
+/** quickSort's partition strategies: partitionAroundPivot's loop,
+    which branches on each comparison, or blockPartition, which does
+    not.  Blocks are the default, and were faster on random float keys
+    and strings; the loop was faster on nearly sorted keys. */
+struct HoarePartition {};
+struct BlockPartition {};
+
+namespace _internal {
+
+template<class Iterator, class KeyOf, class Less>
+inline Iterator partition(Iterator first, Iterator last, KeyOf& keyOf, Less& less, HoarePartition) {
+    return partitionAroundPivot(first, last, keyOf, less);
+}
+
+template<class Iterator, class KeyOf, class Less>
+inline Iterator partition(Iterator first, Iterator last, KeyOf& keyOf, Less& less, BlockPartition) {
+    return blockPartition(first, last, keyOf, less);
+}
+
+} // namespace _internal
+
+/** Sorts [first, last), falling back to heapSort when depthLimit
+    partitions have been made along the current path */
+template<class Iterator, class KeyOf, class Less, class Partition>
+void quickSortRec(Iterator first, Iterator last, int depthLimit, KeyOf& keyOf, Less& less, Partition partition) {
+    const SortInstrument::Level level;
+
+    while (last - first > quickSortCutoff) {
+        if (depthLimit == 0) {
+            // The pivots have been poor; heapSort bounds the time
+            heapSort(first, last, keyOf, less);
+            return;
+        }
+        --depthLimit;
+
+        const Iterator p = _internal::partition(first, last, keyOf, less, partition);
+
+        // Recurse into the smaller side and loop on the larger, so
+        // that the stack depth is O(log N)
+        if (p - first < last - (p + 1)) {
+            quickSortRec(first, p, depthLimit, keyOf, less, partition);
+            first = p + 1;
+        } else {
+            quickSortRec(p + 1, last, depthLimit, keyOf, less, partition);
+            last = p;
+        }
+    }
+
+    _internal::finishPartition(first, last, keyOf, less);
+}
+
+
+/** quickSort with the partition strategy given as HoarePartition()
+    or BlockPartition() */
+template<class Iterator, class KeyOf, class Less, class Partition>
+void quickSort(Iterator first, Iterator last, KeyOf keyOf, Less less, Partition partition) {
+    quickSortRec(first, last, 2 * _internal::floorLog2(last - first), keyOf, less, partition);
+}
+
+template<class Iterator, class KeyOf, class Less>
+void quickSort(Iterator first, Iterator last, KeyOf keyOf, Less less) {
+    quickSort(first, last, keyOf, less, BlockPartition());
+}
+
+template<class Iterator, class KeyOf>
+void quickSort(Iterator first, Iterator last, KeyOf keyOf) {
+    quickSort(first, last, keyOf, KeyLess());
+}
+
+template<class Iterator>
+void quickSort(Iterator first, Iterator last) {
+    quickSort(first, last, SelfKey(), KeyLess());
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Selection: when only the least k elements, or the kth, are needed,
+// these avoid sorting the rest.
+
+namespace _internal {
+
+/** The heap half of partialSort: keeps the least k = middle - first
+    in a max heap on [first, middle), so each later element costs one
+    comparison against the root unless it belongs among them, and then
+    sorts the heap.  O(N log k) time. */
+template<class Iterator, class KeyOf, class Less>
+void heapSelect(Iterator first, Iterator middle, Iterator last, KeyOf& keyOf, Less& less) {
+    const ptrdiff_t k = middle - first;
+
+    // Form a max heap of the first k
+    for (ptrdiff_t i = k / 2 - 1; i >= 0; --i) {
+        siftDown(first, i, k - 1, keyOf, less);
+    }
+
+    // Replace the greatest of the least k so far with each element
+    // that is less than it
+    for (Iterator i = middle; i != last; ++i) {
+        if (less(keyOf(*i), keyOf(*first))) {
+            swapElements(first, i);
+            siftDown(first, 0, k - 1, keyOf, less);
+        }
+    }
+
+    for (ptrdiff_t i = k - 1; i >= 1; --i) {
+        swapElements(first, first + i);
+        siftDown(first, 0, i - 1, keyOf, less);
+    }
+}
+
+} // namespace _internal
+
+/** Rearranges [first, last) so that *nth is the element that would
+    be there if the range were sorted, no element before it has a
+    greater key, and none after has a lesser key.  O(N) time, O(1)
+    additional space.
+
+    This is an introselect: the partition loop of quickSort, following
+    only the side that holds nth, which switches to a heap if the
+    partitions are unbalanced for too long. */
+template<class Iterator, class KeyOf, class Less>
+void select(Iterator first, Iterator nth, Iterator last, KeyOf keyOf, Less less) {
+    int depthLimit = 2 * _internal::floorLog2(last - first);
+
+    while (last - first > quickSortCutoff) {
+        if (depthLimit == 0) {
+            _internal::heapSelect(first, nth + 1, last, keyOf, less);
+            return;
+        }
+        --depthLimit;
+
+        const Iterator p = _internal::blockPartition(first, last, keyOf, less);
+        if (p == nth) {
+            return;
+        } else if (nth < p) {
+            last = p;
+        } else {
+            first = p + 1;
+        }
+    }
+
+    insertionSort(first, last, keyOf, less);
+}
+
+template<class Iterator, class KeyOf>
+void select(Iterator first, Iterator nth, Iterator last, KeyOf keyOf) {
+    select(first, nth, last, keyOf, KeyLess());
+}
+
+template<class Iterator>
+void select(Iterator first, Iterator nth, Iterator last) {
+    select(first, nth, last, SelfKey(), KeyLess());
+}
+
+
+/** partialSort keeps a heap for k up to N / partialSortHeapFraction;
+    above that, selecting and then sorting the least k was faster */
+static const int partialSortHeapFraction = 32;
+
+/** Moves the least middle - first elements of [first, last) into
+    [first, middle), sorted; the rest are left in [middle, last) in
+    no particular order.  O(N log k) time for k = middle - first, O(1)
+    additional space. */
+template<class Iterator, class KeyOf, class Less>
+void partialSort(Iterator first, Iterator middle, Iterator last, KeyOf keyOf, Less less) {
+    const ptrdiff_t k = middle - first;
+
+    if (k <= 0) {
+        return;
+    } else if (middle == last) {
+        quickSort(first, last, keyOf, less);
+    } else if (k > (last - first) / partialSortHeapFraction) {
+        select(first, middle - 1, last, keyOf, less);
+        quickSort(first, middle - 1, keyOf, less);
+    } else {
+        _internal::heapSelect(first, middle, last, keyOf, less);
+    }
+}
+
+template<class Iterator, class KeyOf>
+void partialSort(Iterator first, Iterator middle, Iterator last, KeyOf keyOf) {
+    partialSort(first, middle, last, keyOf, KeyLess());
+}
+
+template<class Iterator>
+void partialSort(Iterator first, Iterator middle, Iterator last) {
+    partialSort(first, middle, last, SelfKey(), KeyLess());
+}
+
+
+/** Keeps the k least of a stream of elements, by keyOf and less as
+    for the sorts, in O(log k) time per element and O(k) space.  For
+    example, to find the 16 nearest lights:
+
+    <pre>
+      TopK<Light, MemberKey> nearest(16);
+      for (...) nearest.insert(light);
+      const std::vector<Light>& result = nearest.sorted();
+    </pre>
+*/
+template<class T, class KeyOf = SelfKey, class Less = KeyLess>
+class TopK {
+public:
+    explicit TopK(size_t k, KeyOf keyOf = KeyOf(), Less less = Less()) :
+        m_k(k), m_heap(), m_keyOf(keyOf), m_less(less) {
+        m_heap.reserve(k);
+    }
+
+    /** Offers an element, which is kept if it is among the k least so
+        far */
+    void insert(const T& value) {
+        if (m_heap.size() < m_k) {
+            m_heap.push_back(value);
+            siftUp(m_heap.size() - 1);
+        } else if ((m_k > 0) && m_less(m_keyOf(value), m_keyOf(m_heap[0]))) {
+            m_heap[0] = value;
+            siftDown(m_heap.begin(), 0, (ptrdiff_t)m_k - 1, m_keyOf, m_less);
+        }
+    }
+
+    /** True once k elements have been kept, after which only elements
+        less than top() are */
+    bool full() const {
+        return m_heap.size() == m_k;
+    }
+
+    /** The greatest element kept.  Requires size() > 0. */
+    const T& top() const {
+        return m_heap[0];
+    }
+
+    size_t size() const {
+        return m_heap.size();
+    }
+
+    /** The elements kept, from least to greatest.  Valid until the
+        next insert or clear. */
+    const std::vector<T>& sorted() {
+        m_sorted = m_heap;
+        heapSort(m_sorted.begin(), m_sorted.end(), m_keyOf, m_less);
+        return m_sorted;
+    }
+
+    void clear() {
+        m_heap.clear();
+    }
+
+private:
+    size_t         m_k;
+
+    /** Max heap of the elements kept */
+    std::vector<T> m_heap;
+
+    std::vector<T> m_sorted;
+    KeyOf          m_keyOf;
+    Less           m_less;
+
+    void siftUp(size_t child) {
+        T value(std::move(m_heap[child]));
+        while (child > 0) {
+            const size_t parent = (child - 1) / 2;
+            if (! m_less(m_keyOf(m_heap[parent]), m_keyOf(value))) break;
+            m_heap[child] = std::move(m_heap[parent]);
+            child = parent;
+        }
+        m_heap[child] = std::move(value);
+    }
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// quickSort2 uses only element[i], so that any array type may be
+// sorted, and is a better base for porting to languages without
+// iterators or pointer arithmetic.
+
+/** insertionSort of element[start, start + N) */
+template<class Array, class KeyOf, class Less>
+void insertionSort2(Array& element, const int start, const int N, KeyOf& keyOf, Less& less) {
+    for (int numSorted = start + 1; numSorted < start + N; ++numSorted) {
+        auto temp = std::move(element[numSorted]);
+
+        int i;
+        for (i = numSorted; (i > start) && _internal::compareKeys(less, keyOf(temp), keyOf(element[i - 1])); --i) {
+            element[i] = std::move(element[i - 1]);
+        }
+
+        element[i] = std::move(temp);
+        SortInstrument::moved(numSorted - i + 2);
+    }
+}
+
+/** siftDown within the heap stored in element[start, start + end] */
+template<class Array, class KeyOf, class Less>
+void siftDown2(Array& element, const int start, int parent, const int end, KeyOf& keyOf, Less& less) {
+    auto value = std::move(element[start + parent]);
+
+    int maxChild = parent * 2 + 1;
+    while (maxChild <= end) {
+        if (maxChild < end) {
+            const int otherChild = maxChild + 1;
+            maxChild = _internal::compareKeys(less, keyOf(element[start + maxChild]), keyOf(element[start + otherChild])) ? otherChild : maxChild;
+        }
+
+        if (! _internal::compareKeys(less, keyOf(value), keyOf(element[start + maxChild]))) break;
+
+        element[start + parent] = std::move(element[start + maxChild]);
+        SortInstrument::moved(1);
+
+        parent = maxChild;
+        maxChild = parent * 2 + 1;
+    }
+
+    element[start + parent] = std::move(value);
+    SortInstrument::moved(2);
+}
+
+/** heapSort of element[start, start + N) */
+template<class Array, class KeyOf, class Less>
+void heapSort2(Array& element, const int start, const int N, KeyOf& keyOf, Less& less) {
+    for (int i = N / 2 - 1; i >= 0; --i)
+        siftDown2(element, start, i, N - 1, keyOf, less);
+
+    for (int i = N - 1; i >= 1; --i) {
+        _internal::swapElements(element, start, start + i);
+        siftDown2(element, start, 0, i - 1, keyOf, less);
+    }
+}
+
+
+template<class Array, class KeyOf, class Less>
+void quickSort2Rec(Array& element, int start, int N, int depthLimit, KeyOf& keyOf, Less& less) {
+    const SortInstrument::Level level;
+
+    while (N > quickSortCutoff) {
+        if (depthLimit == 0) {
+            heapSort2(element, start, N, keyOf, less);
+            return;
+        }
+        --depthLimit;
+
+        // Partition elements
+        _internal::swapElements(element, start, _internal::choosePivot(element, start, N, keyOf, less));
+        typename _internal::PivotKey<KeyOf, typename std::decay<decltype(element[start])>::type>::type pivot = keyOf(element[start]);
+        int i = start;
+        int j = N + start;
+
+        while (true) {
+            while ((++i < N + start) && _internal::compareKeys(less, keyOf(element[i]), pivot));
+            while (_internal::compareKeys(less, pivot, keyOf(element[--j])));
+
+            if (i >= j) break;
+
+            _internal::swapElements(element, i, j);
+        }
+
+        _internal::swapElements(element, i - 1, start);
+
+        const int lowN  = (i - start) - 1;
+        const int highN = N - (i - start);
+        if (lowN < highN) {
+            quickSort2Rec(element, start, lowN, depthLimit, keyOf, less);
+            start = i;
+            N = highN;
+        } else {
+            quickSort2Rec(element, i, highN, depthLimit, keyOf, less);
+            N = lowN;
+        }
+    }
+
+    insertionSort2(element, start, N, keyOf, less);
+}
+
+/** Sorts element[0, N) of any type with operator[] */
+template<class Array, class KeyOf, class Less>
+void quickSort2(Array& element, const int N, KeyOf keyOf, Less less) {
+    quickSort2Rec(element, 0, N, 2 * _internal::floorLog2(N), keyOf, less);
+}
+
+template<class Array, class KeyOf>
+void quickSort2(Array& element, const int N, KeyOf keyOf) {
+    quickSort2(element, N, keyOf, KeyLess());
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// radixSort is an LSD radix sort on the bits of a float key, which
+// takes O(N) time rather than O(N log N), and is stable.  It makes
+// three passes of 11-bit digits, moving every element from one buffer
+// to the other, except that a pass whose digit is the same for every
+// key is skipped.  The histograms for all passes are counted in a
+// single read of the keys.
+
+namespace _internal {
+
+static const int radixBits   = 11;
+static const int radixSize   = 1 << radixBits;
+static const int radixPasses = 3;
+
+/** Maps a float to an unsigned integer in the same order: flips the
+    sign bit of positive numbers and every bit of negative ones.  -0
+    orders before +0, and NaNs go to the ends by their sign. */
+inline uint32_t radixKey(float f) {
+    uint32_t u;
+    memcpy(&u, &f, sizeof(u));
+    return u ^ ((uint32_t)((int32_t)u >> 31) | 0x80000000u);
+}
+
+inline int radixDigit(uint32_t k, int pass) {
+    return (k >> (pass * radixBits)) & (radixSize - 1);
+}
+
+/** Digit counts for every pass */
+struct RadixCount {
+    size_t digit[radixPasses][radixSize];
+};
+
+/** Adds the digits of every key in [first, last) to count */
+template<class T, class KeyOf>
+void radixHistogram(const T* first, const T* last, KeyOf& keyOf, RadixCount& count) {
+    for (const T* e = first; e != last; ++e) {
+        const uint32_t k = radixKey(keyOf(*e));
+        for (int pass = 0; pass < radixPasses; ++pass) {
+            ++count.digit[pass][radixDigit(k, pass)];
+        }
+    }
+}
+
+/** Moves each element of [first, last) to dst[offset[digit]++] */
+template<class T, class KeyOf>
+void radixScatter(T* first, T* last, T* dst, int pass, KeyOf& keyOf, size_t* offset) {
+    for (T* e = first; e != last; ++e) {
+        dst[offset[radixDigit(radixKey(keyOf(*e)), pass)]++] = std::move(*e);
+    }
+}
+
+/** True if every key has the same digit in this pass, which is then
+    skipped */
+inline bool radixConstant(const RadixCount& count, int pass, uint32_t anyKey, size_t N) {
+    return count.digit[pass][radixDigit(anyKey, pass)] == N;
+}
+
+/** The radixKey of keyOf, for comparison sorts to order keys exactly
+    as radixSort does */
+template<class KeyOf>
+struct RadixKeyOf {
+    KeyOf& keyOf;
+    explicit RadixKeyOf(KeyOf& keyOf) : keyOf(keyOf) {}
+    template<class T>
+    uint32_t operator()(const T& x) const {
+        return radixKey(keyOf(x));
+    }
+};
+
+/** Runs f(t) for t in [0, threads), on threads - 1 new threads and
+    this one */
+template<class F>
+void runThreads(int threads, F f) {
+    std::vector<std::thread> thread;
+    for (int t = 1; t < threads; ++t) {
+        thread.push_back(std::thread(f, t));
+    }
+    f(0);
+    for (size_t t = 0; t < thread.size(); ++t) {
+        thread[t].join();
+    }
+}
+
+/** Blocks each of a fixed number of threads in wait() until all have
+    arrived, repeatedly */
+class ThreadBarrier {
+public:
+    explicit ThreadBarrier(int threads) : m_threads(threads), m_waiting(0), m_generation(0) {}
+
+    /** Waits for the other threads.  The last to arrive runs
+        lastArrival() before releasing them. */
+    template<class F>
+    void wait(F lastArrival) {
+        std::unique_lock<std::mutex> lock(m_lock);
+        const unsigned int generation = m_generation;
+        if (++m_waiting == m_threads) {
+            lastArrival();
+            m_waiting = 0;
+            ++m_generation;
+            m_released.notify_all();
+        } else {
+            m_released.wait(lock, [&] { return m_generation != generation; });
+        }
+    }
+
+private:
+    std::mutex              m_lock;
+    std::condition_variable m_released;
+    int                     m_threads;
+    int                     m_waiting;
+    unsigned int            m_generation;
+};
+
+} // namespace _internal
+
+/** radixSort gives arrays of at most this many elements to mergeSort,
+    because clearing and summing the 48 kB of digit counts costs more
+    than comparing so few keys */
+static const int radixSortCutoff = 128;
+
+
+/** Sorts the array [first, last) by a float key, through the
+    caller's scratch, which has room for last - first elements
+    (constructed, if they are not trivially copyable).  Does not
+    allocate. */
+template<class T, class KeyOf>
+void radixSort(T* first, T* last, KeyOf keyOf, T* scratch) {
+    using namespace _internal;
+
+    const size_t N = last - first;
+    if (N < 2) return;
+
+    if (N <= (size_t)radixSortCutoff) {
+        mergeSort(first, last, RadixKeyOf<KeyOf>(keyOf), KeyLess(), scratch);
+        return;
+    }
+
+    RadixCount count;
+    memset(&count, 0, sizeof(count));
+    radixHistogram(first, last, keyOf, count);
+
+    const uint32_t anyKey = radixKey(keyOf(*first));
+    T* src = first;
+    T* dst = scratch;
+
+    for (int pass = 0; pass < radixPasses; ++pass) {
+        if (radixConstant(count, pass, anyKey, N)) continue;
+
+        size_t offset[radixSize];
+        size_t sum = 0;
+        for (int d = 0; d < radixSize; ++d) {
+            offset[d] = sum;
+            sum += count.digit[pass][d];
+        }
+
+        radixScatter(src, src + N, dst, pass, keyOf, offset);
+        std::swap(src, dst);
+    }
+
+    // After an odd number of passes the result is in scratch
+    if (src != first) {
+        std::move(src, src + N, first);
+    }
+}
+
+/** radixSort through the thread's SortArena, or for elements that are
+    not trivially copyable, a vector of default-constructed ones */
+template<class T, class KeyOf>
+void radixSort(T* first, T* last, KeyOf keyOf) {
+    if (last - first < 2) return;
+    _internal::Scratch<T> scratch(last - first);
+    radixSort(first, last, keyOf, scratch.data());
+}
+
+template<class T>
+void radixSort(T* first, T* last) {
+    radixSort(first, last, SelfKey());
+}
+
+
+/** radixSort, on up to the given number of threads (by default, one
+    per core).  Each thread counts and then scatters its own slice of
+    the array; a thread's share of each digit's output follows the
+    shares of the threads before it, which keeps the sort stable.
+    Arrays too small to share go to radixSort. */
+template<class T, class KeyOf>
+void parallelRadixSort(T* first, T* last, KeyOf keyOf, int threads = 0) {
+    using namespace _internal;
+
+    // Fewer elements than this per thread are not worth a thread
+    static const size_t grain = 1 << 16;
+
+    // Decided before asking for the core count, which glibc reads from
+    // sysfs on every call
+    const size_t N = last - first;
+    if (N < 2 * grain) {
+        radixSort(first, last, keyOf);
+        return;
+    }
+
+    if (threads <= 0) {
+        threads = std::max(1, (int)std::thread::hardware_concurrency());
+    }
+    threads = (int)std::min((size_t)threads, N / grain);
+    if (threads <= 1) {
+        radixSort(first, last, keyOf);
+        return;
+    }
+
+    std::vector<size_t> bound(threads + 1);
+    for (int t = 0; t <= threads; ++t) {
+        bound[t] = N * t / threads;
+    }
+
+    std::vector<RadixCount> count(threads);
+    RadixCount total;
+    std::vector<size_t> offset(threads * radixSize);
+    const uint32_t anyKey = radixKey(keyOf(*first));
+    Scratch<T> scratch(N);
+    ThreadBarrier barrier(threads);
+
+    // Offsets, in order of digit and then of thread
+    auto computeOffsets = [&](int pass) {
+        size_t sum = 0;
+        for (int d = 0; d < radixSize; ++d) {
+            for (int t = 0; t < threads; ++t) {
+                offset[t * radixSize + d] = sum;
+                sum += count[t].digit[pass][d];
+            }
+        }
+    };
+
+    // The threads are started once and meet at the barrier between
+    // steps; the last to arrive does the serial work of each step
+    runThreads(threads, [&](int t) {
+        // Per-thread histograms for every pass, from the original order
+        memset(&count[t], 0, sizeof(RadixCount));
+        radixHistogram(first + bound[t], first + bound[t + 1], keyOf, count[t]);
+        barrier.wait([&] {
+            memset(&total, 0, sizeof(total));
+            for (int u = 0; u < threads; ++u) {
+                for (int pass = 0; pass < radixPasses; ++pass) {
+                    for (int d = 0; d < radixSize; ++d) {
+                        total.digit[pass][d] += count[u].digit[pass][d];
+                    }
+                }
+            }
+        });
+
+        T* src = first;
+        T* dst = scratch.data();
+        bool recount = false;
+
+        for (int pass = 0; pass < radixPasses; ++pass) {
+            if (radixConstant(total, pass, anyKey, N)) continue;
+
+            // After the first scatter, each slice holds different elements
+            // and must be counted again for this pass
+            if (recount) {
+                size_t* c = count[t].digit[pass];
+                memset(c, 0, sizeof(size_t) * radixSize);
+                for (const T* e = src + bound[t]; e != src + bound[t + 1]; ++e) {
+                    ++c[radixDigit(radixKey(keyOf(*e)), pass)];
+                }
+            }
+            recount = true;
+
+            barrier.wait([&] { computeOffsets(pass); });
+            radixScatter(src + bound[t], src + bound[t + 1], dst, pass, keyOf, &offset[t * radixSize]);
+            std::swap(src, dst);
+
+            // No thread may count or move src until all have scattered
+            barrier.wait([] {});
+        }
+
+        if (src != first) {
+            std::move(src + bound[t], src + bound[t + 1], first + bound[t]);
+        }
+    });
+}
+
+template<class T>
+void parallelRadixSort(T* first, T* last) {
+    parallelRadixSort(first, last, SelfKey());
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Tag sorting: rather than moving large elements at every step of a
+// sort, sort a compact array of (key, index) pairs and then move each
+// element once, or not at all, using the sorted indices to reach the
+// elements in order.  Elements then move O(N) times rather than
+// O(N log N), at the price of random access when they are permuted.
+
+/** A key and the index of the element it came from */
+struct KeyIndex {
+    float    key;
+    uint32_t index;
+};
+
+namespace _internal {
+
+/** Returns the tags of element[0, N) sorted by key, stably, from the
+    thread's SortArena.  The N tags after them are scratch. */
+template<class T, class KeyOf>
+KeyIndex* sortedTags(const T* element, const size_t N, KeyOf& keyOf) {
+    KeyIndex* tag = (KeyIndex*)SortArena::local().reserve(2 * N * sizeof(KeyIndex));
+    for (size_t i = 0; i < N; ++i) {
+        tag[i].key   = keyOf(element[i]);
+        tag[i].index = (uint32_t)i;
+    }
+
+    radixSort(tag, tag + N, MemberKey(), tag + N);
+    return tag;
+}
+
+} // namespace _internal
+
+/** Reorders element[0, N) so that element i becomes the one that was
+    at index[i], following each cycle of the permutation and moving
+    every element once.  index must be a permutation of [0, N); it is
+    left as the identity. */
+template<class T>
+void permute(T* element, uint32_t* index, const size_t N) {
+    for (size_t start = 0; start < N; ++start) {
+        if (index[start] == start) continue;
+
+        T temp(std::move(element[start]));
+        size_t i = start;
+        while (index[i] != start) {
+            const size_t next = index[i];
+            element[i] = std::move(element[next]);
+            index[i] = (uint32_t)i;
+            i = next;
+        }
+        element[i] = std::move(temp);
+        index[i] = (uint32_t)i;
+    }
+}
+
+/** Writes to index[0, N) the order of element[0, N) by a float key, so
+    that element[index[0]] has the least key, without moving the
+    elements.  Stable.  Uses 16N bytes of the thread's SortArena;
+    N must be less than 2^32. */
+template<class T, class KeyOf>
+void tagSortIndex(const T* element, const size_t N, KeyOf keyOf, uint32_t* index) {
+    const KeyIndex* tag = _internal::sortedTags(element, N, keyOf);
+    for (size_t i = 0; i < N; ++i) {
+        index[i] = tag[i].index;
+    }
+}
+
+/** Sorts the array [first, last) by a float key, moving each element
+    only once, after sorting (key, index) tags with radixSort.  Stable.
+    For elements much larger than 8 bytes this moves far less memory
+    than the other sorts.  Uses 16N bytes of the thread's SortArena;
+    N must be less than 2^32. */
+template<class T, class KeyOf>
+void tagSort(T* first, T* last, KeyOf keyOf) {
+    const size_t N = last - first;
+    const KeyIndex* tag = _internal::sortedTags(first, N, keyOf);
+
+    // The indices go in the scratch half of the arena
+    uint32_t* index = (uint32_t*)(tag + N);
+    for (size_t i = 0; i < N; ++i) {
+        index[i] = tag[i].index;
+    }
+    permute(first, index, N);
+}
+
+template<class T>
+void tagSort(T* first, T* last) {
+    tagSort(first, last, SelfKey());
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+/** A small work-stealing thread pool for fork-join sorting.
+
+    invoke(a, b) runs a on the calling thread while b waits on the
+    calling thread's queue, where an idle worker may steal it.  If no
+    one has, the caller runs b itself; otherwise it runs other waiting
+    tasks until b is done, so that nested invokes never block a
+    thread.  Each worker takes its newest task first and steals the
+    oldest task of another, which for divide and conquer is the
+    largest.
+
+    Threads that are not workers share one queue, so any thread may
+    call invoke. */
+class SortPool {
+public:
+
+    /** Starts threads - 1 workers (by default, one fewer than the
+        number of cores); the caller is the last thread */
+    explicit SortPool(int threads = 0) : m_queue(), m_worker(), m_idleLock(), m_idle(), m_pending(0), m_stop(false) {
+        if (threads <= 0) {
+            threads = std::max(1, (int)std::thread::hardware_concurrency());
+        }
+        for (int t = 0; t < threads; ++t) {
+            m_queue.push_back(std::unique_ptr<Queue>(new Queue()));
+        }
+        for (int t = 1; t < threads; ++t) {
+            m_worker.push_back(std::thread(&SortPool::work, this, t));
+        }
+    }
+
+    ~SortPool() {
+        {
+            std::lock_guard<std::mutex> lock(m_idleLock);
+            m_stop = true;
+        }
+        m_idle.notify_all();
+        for (size_t t = 0; t < m_worker.size(); ++t) {
+            m_worker[t].join();
+        }
+    }
+
+    /** Number of threads, including the caller */
+    int size() const {
+        return (int)m_queue.size();
+    }
+
+    /** Runs a() and b(), possibly at the same time, and returns when
+        both are done */
+    template<class A, class B>
+    void invoke(A a, B b) {
+        if (m_worker.empty()) {
+            a();
+            b();
+            return;
+        }
+
+        const int slot = currentSlot();
+        Task task;
+        task.run = b;
+        push(slot, &task);
+
+        a();
+
+        while (! task.done.load(std::memory_order_acquire)) {
+            Task* other = take(slot);
+            if (other != NULL) {
+                run(other);
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    /** A pool shared by the Element sorts in sort.cpp */
+    static SortPool& common() {
+        static SortPool pool;
+        return pool;
+    }
+
+private:
+
+    struct Task {
+        std::function<void()> run;
+        std::atomic<bool>     done;
+        Task() : run(), done(false) {}
+    };
+
+    struct Queue {
+        std::mutex         lock;
+        std::deque<Task*>  task;
+    };
+
+    /** Which pool, and which queue in it, the current thread works for */
+    struct Slot {
+        const SortPool* pool;
+        int             slot;
+    };
+
+    static Slot& threadSlot() {
+        static thread_local Slot s = {NULL, 0};
+        return s;
+    }
+
+    std::vector<std::unique_ptr<Queue>> m_queue;
+    std::vector<std::thread>            m_worker;
+    std::mutex                          m_idleLock;
+    std::condition_variable             m_idle;
+    std::atomic<int>                    m_pending;
+    bool                                m_stop;
+
+    SortPool(const SortPool&);
+    SortPool& operator=(const SortPool&);
+
+    int currentSlot() const {
+        const Slot& s = threadSlot();
+        return (s.pool == this) ? s.slot : 0;
+    }
+
+    void push(int slot, Task* task) {
+        {
+            std::lock_guard<std::mutex> lock(m_queue[slot]->lock);
+            m_queue[slot]->task.push_back(task);
+        }
+        ++m_pending;
+        std::lock_guard<std::mutex> lock(m_idleLock);
+        m_idle.notify_one();
+    }
+
+    /** The newest task on this slot's queue, else the oldest on another's */
+    Task* take(int slot) {
+        const int n = size();
+        for (int k = 0; k < n; ++k) {
+            Queue& q = *m_queue[(slot + k) % n];
+            std::lock_guard<std::mutex> lock(q.lock);
+            if (! q.task.empty()) {
+                Task* task;
+                if (k == 0) {
+                    task = q.task.back();
+                    q.task.pop_back();
+                } else {
+                    task = q.task.front();
+                    q.task.pop_front();
+                }
+                --m_pending;
+                return task;
+            }
+        }
+        return NULL;
+    }
+
+    static void run(Task* task) {
+        task->run();
+        task->done.store(true, std::memory_order_release);
+    }
+
+    void work(int slot) {
+        threadSlot().pool = this;
+        threadSlot().slot = slot;
+
+        while (true) {
+            Task* task = take(slot);
+            if (task != NULL) {
+                run(task);
+            } else {
+                std::unique_lock<std::mutex> lock(m_idleLock);
+                m_idle.wait(lock, [this] { return m_stop || (m_pending > 0); });
+                if (m_stop) return;
+            }
+        }
+    }
+};
+
+/** Ranges of at most this many elements are sorted, merged, or moved
+    by one thread in the parallel sorts */
+static const size_t parallelSortGrain = 1 << 14;
+
+namespace _internal {
+
+/** Moves [first, last) to out, sharing the work on pool */
+template<class T>
+void parallelMove(T* first, T* last, T* out, SortPool& pool, size_t grain) {
+    const size_t N = last - first;
+    if (N <= grain) {
+        std::move(first, last, out);
+    } else {
+        const size_t h = N / 2;
+        pool.invoke([&] { parallelMove(first, first + h, out, pool, grain); },
+                    [&] { parallelMove(first + h, last, out + h, pool, grain); });
+    }
+}
+
+/** Merges the sorted ranges [a, aEnd) and [b, bEnd), which it
+    precedes, into out.  The larger range is split at its middle
+    element, which is found in the other by binary search, and both
+    halves are merged at the same time.  Equal keys are taken from [a, aEnd) first. */
+template<class T, class KeyOf, class Less>
+void parallelMerge(T* a, T* aEnd, T* b, T* bEnd, T* out, KeyOf& keyOf, Less& less, SortPool& pool, size_t grain) {
+    const size_t aN = aEnd - a;
+    const size_t bN = bEnd - b;
+
+    if (aN + bN <= grain) {
+        mergeInto(a, aEnd, b, bEnd, out, keyOf, less);
+        return;
+    }
+
+    // The middle element goes straight to its place in out, and each
+    // half is merged without it
+    T* aMid;
+    T* bMid;
+    T* aNext;
+    T* bNext;
+    if (aN >= bN) {
+        aMid  = a + aN / 2;
+        bMid  = std::lower_bound(b, bEnd, *aMid, [&](const T& x, const T& y) { return less(keyOf(x), keyOf(y)); });
+        aNext = aMid + 1;
+        bNext = bMid;
+        out[(aMid - a) + (bMid - b)] = std::move(*aMid);
+    } else {
+        bMid  = b + bN / 2;
+        aMid  = std::upper_bound(a, aEnd, *bMid, [&](const T& x, const T& y) { return less(keyOf(x), keyOf(y)); });
+        aNext = aMid;
+        bNext = bMid + 1;
+        out[(aMid - a) + (bMid - b)] = std::move(*bMid);
+    }
+
+    T* outNext = out + (aMid - a) + (bMid - b) + 1;
+    pool.invoke([&] { parallelMerge(a, aMid, b, bMid, out, keyOf, less, pool, grain); },
+                [&] { parallelMerge(aNext, aEnd, bNext, bEnd, outNext, keyOf, less, pool, grain); });
+}
+
+/** Sorts [first, last), using the same range of temp */
+template<class T, class KeyOf, class Less>
+void parallelMergeSortRec(T* first, T* last, T* temp, KeyOf& keyOf, Less& less, SortPool& pool, size_t grain) {
+    const size_t N = last - first;
+    if (N <= grain) {
+        mergeSort(first, last, keyOf, less, temp);
+        return;
+    }
+
+    T* mid = first + N / 2;
+    T* tempMid = temp + N / 2;
+    pool.invoke([&] { parallelMergeSortRec(first, mid, temp, keyOf, less, pool, grain); },
+                [&] { parallelMergeSortRec(mid, last, tempMid, keyOf, less, pool, grain); });
+
+    parallelMerge(first, mid, mid, last, temp, keyOf, less, pool, grain);
+    parallelMove(temp, temp + N, first, pool, grain);
+}
+
+template<class T, class KeyOf, class Less>
+void parallelQuickSortRec(T* first, T* last, int depthLimit, KeyOf& keyOf, Less& less, SortPool& pool, size_t grain) {
+    if ((size_t)(last - first) <= grain) {
+        quickSortRec(first, last, depthLimit, keyOf, less, BlockPartition());
+    } else if (depthLimit == 0) {
+        heapSort(first, last, keyOf, less);
+    } else {
+        T* p = blockPartition(first, last, keyOf, less);
+        pool.invoke([&] { parallelQuickSortRec(first, p, depthLimit - 1, keyOf, less, pool, grain); },
+                    [&] { parallelQuickSortRec(p + 1, last, depthLimit - 1, keyOf, less, pool, grain); });
+    }
+}
+
+} // namespace _internal
+
+
+/** mergeSort of the array [first, last), with both halves of every
+    split sorted at the same time and merged by several threads.
+    Stable.  Ranges of at most grain elements are sorted and merged
+    sequentially.  The O(N) scratch comes from the calling thread's
+    SortArena, else the elements must be default-constructible. */
+template<class T, class KeyOf, class Less>
+void parallelMergeSort(T* first, T* last, KeyOf keyOf, Less less, SortPool& pool = SortPool::common(), size_t grain = parallelSortGrain) {
+    grain = std::max(grain, (size_t)1);
+    if ((size_t)(last - first) <= grain) {
+        mergeSort(first, last, keyOf, less);
+        return;
+    }
+    _internal::Scratch<T> temp(last - first);
+    _internal::parallelMergeSortRec(first, last, temp.data(), keyOf, less, pool, grain);
+}
+
+template<class T, class KeyOf>
+void parallelMergeSort(T* first, T* last, KeyOf keyOf) {
+    parallelMergeSort(first, last, keyOf, KeyLess());
+}
+
+/** quickSort of the array [first, last), sorting both sides of every
+    partition larger than grain elements at the same time.  The first
+    partition is made by one thread, which bounds the speedup. */
+template<class T, class KeyOf, class Less>
+void parallelQuickSort(T* first, T* last, KeyOf keyOf, Less less, SortPool& pool = SortPool::common(), size_t grain = parallelSortGrain) {
+    grain = std::max(grain, (size_t)quickSortCutoff);
+    _internal::parallelQuickSortRec(first, last, 2 * _internal::floorLog2(last - first), keyOf, less, pool, grain);
+}
+
+template<class T, class KeyOf>
+void parallelQuickSort(T* first, T* last, KeyOf keyOf) {
+    parallelQuickSort(first, last, keyOf, KeyLess());
+}
+
+#endif
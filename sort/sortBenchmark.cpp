@@ -0,0 +1,444 @@
+/**
+   \file sortBenchmark.cpp
+
+   Times the sorts in sort.h on a grid of sizes, input distributions,
+   and record types, and prints one CSV line per combination, to be
+   kept and compared over time.  No dependencies beyond sort.h:
+
+   <pre>
+     g++ -std=c++11 -O2 -pthread sortBenchmark.cpp -o sortBenchmark
+     ./sortBenchmark > results.csv
+     ./sortBenchmark --max 100000000 --algorithms quickSort,radixSort
+   </pre>
+
+   Run with --help for the options.  Each combination is run once to
+   warm up and then repeated, and the minimum, median, mean, and
+   standard deviation of the time per element are reported, with the
+   median in cycles per element where a cycle counter is available
+   (the time stamp counter on x86, which counts at a constant rate
+   rather than the core clock).
+
+   Compiled with -DSORT_INSTRUMENT, each line also has the key
+   comparisons, moves, and swaps per element, and the deepest
+   recursion, from the warm-up run of each sort that SortCounters
+   covers.  The counting slows those sorts, so their times are not
+   comparable to an uninstrumented build.
+
+   Each line also has the heap allocations per sort, counted by
+   replacing the global operator new, over the timed runs; the
+   warm-up run is where the SortArena grows, and is not counted.
+   The sequential sorts on trivially copyable records should show
+   zero.
+
+   Small arrays are timed in batches of many different arrays, so
+   that the branch predictor cannot learn a single input; repeating
+   one small array made branchy sorts look up to twice as fast as
+   they are on real data.
+
+   \author Morgan McGuire, morgan@cs.williams.edu.
+
+   http://graphics.cs.williams.edu
+   http://cs.williams.edu/~morgan/code/
+
+   License: BSD (see download page)
+ */
+#include "sort.h"
+
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#   include <x86intrin.h>
+#   define SORT_BENCHMARK_CYCLES 1
+#else
+#   define SORT_BENCHMARK_CYCLES 0
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+// Every heap allocation through operator new, on any thread.  The
+// library's operator delete frees these, as it calls free().
+
+static std::atomic<uint64_t> allocations(0);
+
+void* operator new(size_t bytes) {
+    ++allocations;
+    void* p = malloc(std::max(bytes, (size_t)1));
+    if (p == NULL) throw std::bad_alloc();
+    return p;
+}
+
+void* operator new[](size_t bytes) {
+    return operator new(bytes);
+}
+
+void* operator new(size_t bytes, const std::nothrow_t&) noexcept {
+    ++allocations;
+    return malloc(std::max(bytes, (size_t)1));
+}
+
+void* operator new[](size_t bytes, const std::nothrow_t& nothrow) noexcept {
+    return operator new(bytes, nothrow);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Record types: a key and a payload that moves with it
+
+template<class K, int payloadBytes>
+struct Record {
+    K    key;
+    char payload[payloadBytes];
+};
+
+struct SmallRecord {
+    float    key;
+    uint32_t payload;
+};
+
+struct WideKeyRecord {
+    double   key;
+    uint64_t payload;
+};
+
+typedef Record<float, 60> LargeRecord;
+
+///////////////////////////////////////////////////////////////////////////////
+// Input distributions
+
+enum Distribution {
+    RANDOM,
+    SORTED,
+    REVERSED,
+    FEW_UNIQUE,
+    ORGAN_PIPE,
+    NEARLY_SORTED,
+    DISTRIBUTION_COUNT
+};
+
+static const char* distributionName[DISTRIBUTION_COUNT] = {
+    "random", "sorted", "reversed", "fewUnique", "organPipe", "nearlySorted"
+};
+
+/** Fills key[0, N) from the distribution.  fewUnique has 16 distinct
+    keys; nearlySorted is sorted with 1% of the keys exchanged with
+    others at random positions. */
+template<class K>
+void makeKeys(Distribution d, K* key, size_t N, std::mt19937_64& rng) {
+    switch (d) {
+    case RANDOM:
+        for (size_t i = 0; i < N; ++i) key[i] = (K)(rng() >> 40);
+        break;
+
+    case SORTED:
+    case NEARLY_SORTED:
+        for (size_t i = 0; i < N; ++i) key[i] = (K)i;
+        if (d == NEARLY_SORTED) {
+            for (size_t i = 0; i < N / 100; ++i) {
+                std::swap(key[rng() % N], key[rng() % N]);
+            }
+        }
+        break;
+
+    case REVERSED:
+        for (size_t i = 0; i < N; ++i) key[i] = (K)(N - i);
+        break;
+
+    case FEW_UNIQUE:
+        for (size_t i = 0; i < N; ++i) key[i] = (K)(rng() % 16);
+        break;
+
+    case ORGAN_PIPE:
+        for (size_t i = 0; i < N; ++i) key[i] = (K)std::min(i, N - i);
+        break;
+
+    default:
+        break;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+struct Options {
+    size_t      minN;
+    size_t      maxN;
+    int         reps;
+    double      minSeconds;
+    size_t      maxBytes;
+    std::string algorithms;
+    std::string distributions;
+    std::string records;
+
+    Options() : minN(8), maxN(1000000), reps(5), minSeconds(0.1), maxBytes((sizeof(size_t) > 4) ? ((size_t)4 << 30) : ((size_t)1 << 31)) {}
+};
+
+/** True if name is in the comma-separated list, or the list is empty */
+static bool selected(const std::string& list, const char* name) {
+    if (list.empty()) return true;
+    const std::string padded = "," + list + ",";
+    return padded.find("," + std::string(name) + ",") != std::string::npos;
+}
+
+static double now() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static uint64_t cycles() {
+#   if SORT_BENCHMARK_CYCLES
+        return __rdtsc();
+#   else
+        return 0;
+#   endif
+}
+
+/** A sort under test, the largest N to give it, and whether
+    SortInstrument counts all of its work */
+template<class T>
+struct Algorithm {
+    const char*                   name;
+    std::function<void(T*, T*)>   sort;
+    size_t                        maxN;
+    bool                          counted;
+};
+
+/** Float keys can also use the sorts on their bits */
+template<class T>
+void addKeyBitSorts(std::vector<Algorithm<T> >& list, std::true_type) {
+    list.push_back({"radixSort",         [](T* a, T* b) { radixSort(a, b, MemberKey()); },         (size_t)-1, false});
+    list.push_back({"parallelRadixSort", [](T* a, T* b) { parallelRadixSort(a, b, MemberKey()); }, (size_t)-1, false});
+    list.push_back({"tagSort",           [](T* a, T* b) { tagSort(a, b, MemberKey()); },           (size_t)-1, false});
+}
+
+template<class T>
+void addKeyBitSorts(std::vector<Algorithm<T> >&, std::false_type) {}
+
+template<class T>
+std::vector<Algorithm<T> > algorithms() {
+    std::vector<Algorithm<T> > list;
+    list.push_back({"insertionSort",     [](T* a, T* b) { insertionSort(a, b, MemberKey()); },                           (size_t)1 << 15, true});
+    list.push_back({"heapSort",          [](T* a, T* b) { heapSort(a, b, MemberKey()); },                                (size_t)-1, true});
+    list.push_back({"mergeSort",         [](T* a, T* b) { mergeSort(a, b, MemberKey()); },                               (size_t)-1, true});
+    list.push_back({"powerSort",         [](T* a, T* b) { powerSort(a, b, MemberKey()); },                               (size_t)-1, false});
+    list.push_back({"quickSort",         [](T* a, T* b) { quickSort(a, b, MemberKey()); },                               (size_t)-1, true});
+    list.push_back({"quickSortHoare",    [](T* a, T* b) { quickSort(a, b, MemberKey(), KeyLess(), HoarePartition()); },  (size_t)-1, true});
+    list.push_back({"quickSort2",        [](T* a, T* b) { quickSort2(a, (int)(b - a), MemberKey()); },                   (size_t)INT32_MAX, true});
+    list.push_back({"parallelMergeSort", [](T* a, T* b) { parallelMergeSort(a, b, MemberKey()); },                       (size_t)-1, false});
+    list.push_back({"parallelQuickSort", [](T* a, T* b) { parallelQuickSort(a, b, MemberKey()); },                       (size_t)-1, false});
+    addKeyBitSorts(list, std::integral_constant<bool, std::is_same<decltype(T().key), float>::value>());
+    list.push_back({"std::sort",         [](T* a, T* b) { std::sort(a, b, [](const T& x, const T& y) { return x.key < y.key; }); },        (size_t)-1, false});
+    list.push_back({"std::stable_sort",  [](T* a, T* b) { std::stable_sort(a, b, [](const T& x, const T& y) { return x.key < y.key; }); }, (size_t)-1, false});
+    return list;
+}
+
+/** Summary of the samples, which are sorted */
+struct Statistics {
+    double min, median, mean, stddev;
+
+    explicit Statistics(std::vector<double>& sample) {
+        std::sort(sample.begin(), sample.end());
+        const size_t n = sample.size();
+        min    = sample[0];
+        median = (n % 2 == 1) ? sample[n / 2] : 0.5 * (sample[n / 2 - 1] + sample[n / 2]);
+
+        double sum = 0;
+        for (size_t i = 0; i < n; ++i) sum += sample[i];
+        mean = sum / n;
+
+        double squares = 0;
+        for (size_t i = 0; i < n; ++i) squares += (sample[i] - mean) * (sample[i] - mean);
+        stddev = (n > 1) ? sqrt(squares / (n - 1)) : 0.0;
+    }
+};
+
+/** Times every selected algorithm on records of type T */
+template<class T>
+void benchmark(const char* recordName, const Options& options) {
+    if (! selected(options.records, recordName)) return;
+
+    typedef decltype(T().key) K;
+    const std::vector<Algorithm<T> > list = algorithms<T>();
+
+    for (size_t N = options.minN; N <= options.maxN; N = (N * 8 > options.maxN && N < options.maxN) ? options.maxN : N * 8) {
+        // Small N is timed over a batch of different arrays
+        const size_t batch = std::max((size_t)1, ((size_t)1 << 16) / N);
+        const size_t total = N * batch;
+        if (3 * total * sizeof(T) > options.maxBytes) {
+            fprintf(stderr, "Skipping %s N=%zu: over --max-bytes\n", recordName, N);
+            break;
+        }
+
+        std::vector<T> source(total);
+        std::vector<T> work(total);
+        std::vector<K> key(N);
+
+        for (int d = 0; d < DISTRIBUTION_COUNT; ++d) {
+            if (! selected(options.distributions, distributionName[d])) continue;
+
+            std::mt19937_64 rng(N * DISTRIBUTION_COUNT + d);
+            for (size_t b = 0; b < batch; ++b) {
+                makeKeys((Distribution)d, key.data(), N, rng);
+                for (size_t i = 0; i < N; ++i) {
+                    T& r = source[b * N + i];
+                    memset(&r, 0, sizeof(T));
+                    r.key = key[i];
+                }
+            }
+
+            for (size_t a = 0; a < list.size(); ++a) {
+                const Algorithm<T>& algorithm = list[a];
+                if ((N > algorithm.maxN) || ! selected(options.algorithms, algorithm.name)) continue;
+
+                std::vector<double> nsPerElement;
+                SortCounters& counters = SortCounters::local();
+                SortCounters counted;
+                std::vector<double> cyclesPerElement;
+                uint64_t allocated = 0;
+                const double start = now();
+
+                // The first run warms up the caches, the SortPool, and the
+                // SortArena, and is checked
+                for (int rep = -1; (rep < options.reps) || (now() - start < options.minSeconds); ++rep) {
+                    memcpy(work.data(), source.data(), total * sizeof(T));
+
+                    counters.reset();
+                    const uint64_t a0 = allocations;
+                    const double   t0 = now();
+                    const uint64_t c0 = cycles();
+                    for (size_t b = 0; b < batch; ++b) {
+                        algorithm.sort(work.data() + b * N, work.data() + (b + 1) * N);
+                    }
+                    const uint64_t c1 = cycles();
+                    const double   t1 = now();
+                    const uint64_t a1 = allocations;
+
+                    if (rep < 0) {
+                        counted = counters;
+                        for (size_t i = 1; i < total; ++i) {
+                            if ((i % N != 0) && (work[i].key < work[i - 1].key)) {
+                                fprintf(stderr, "%s did not sort %s %s N=%zu\n", algorithm.name, distributionName[d], recordName, N);
+                                exit(1);
+                            }
+                        }
+                    } else {
+                        allocated += a1 - a0;
+                        nsPerElement.push_back((t1 - t0) * 1e9 / total);
+                        cyclesPerElement.push_back((double)(c1 - c0) / total);
+                    }
+                }
+
+                const Statistics ns(nsPerElement);
+                const Statistics cy(cyclesPerElement);
+                printf("%s,%s,%s,%zu,%zu,%zu,%.3f,%.3f,%.3f,%.3f,",
+                       algorithm.name, distributionName[d], recordName, sizeof(T), N, nsPerElement.size(),
+                       ns.min, ns.median, ns.mean, ns.stddev);
+                if (SORT_BENCHMARK_CYCLES) {
+                    printf("%.3f", cy.median);
+                }
+                printf(",%.3f", (double)allocated / (nsPerElement.size() * batch));
+                if (SortInstrument::enabled && algorithm.counted) {
+                    printf(",%.3f,%.3f,%.3f,%d\n",
+                           (double)counted.comparisons / total, (double)counted.moves / total,
+                           (double)counted.swaps / total, counted.maxDepth);
+                } else {
+                    printf(",,,,\n");
+                }
+                fflush(stdout);
+            }
+        }
+
+        if (N == options.maxN) break;
+    }
+}
+
+/** Checks PriorityQueue::assign on an empty, a one-element, and a
+    larger range, which the sorts above do not reach */
+static void checkPriorityQueue() {
+    for (size_t N = 0; N <= 100; N = (N < 2) ? N + 1 : N * 10) {
+        std::vector<std::string> value(N);
+        for (size_t i = 0; i < N; ++i) {
+            value[i] = std::to_string((i * 7919) % 1000);
+        }
+
+        PriorityQueue<std::string> queue;
+        queue.assign(value.begin(), value.end());
+        std::sort(value.begin(), value.end());
+
+        for (size_t i = 0; i < N; ++i) {
+            if (queue.empty() || (queue.top() != value[i])) {
+                fprintf(stderr, "PriorityQueue::assign did not order N=%zu\n", N);
+                exit(1);
+            }
+            queue.pop();
+        }
+        if (! queue.empty()) {
+            fprintf(stderr, "PriorityQueue::assign left extra elements N=%zu\n", N);
+            exit(1);
+        }
+    }
+}
+
+
+static void usage() {
+    printf("sortBenchmark [options] > results.csv\n"
+           "  --min N               smallest array (default 8); sizes grow by 8x\n"
+           "  --max N               largest array (default 1000000; up to 1e8)\n"
+           "  --reps R              timed repetitions after warm-up (default 5)\n"
+           "  --min-seconds S       repeat until this much time has passed (default 0.1)\n"
+           "  --max-bytes B         skip sizes needing more memory (default 2^32)\n"
+           "  --algorithms a,b      only these, e.g. quickSort,std::sort\n"
+           "  --distributions a,b   only these, of random, sorted, reversed,\n"
+           "                        fewUnique, organPipe, nearlySorted\n"
+           "  --records a,b         only these, of float+4, float+60, double+8\n");
+}
+
+int main(int argc, const char* argv[]) {
+    Options options;
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const char* value = (i + 1 < argc) ? argv[i + 1] : "";
+        if (arg == "--help") {
+            usage();
+            return 0;
+        } else if (arg == "--min") {
+            options.minN = (size_t)atof(value);
+        } else if (arg == "--max") {
+            options.maxN = (size_t)atof(value);
+        } else if (arg == "--reps") {
+            options.reps = atoi(value);
+        } else if (arg == "--min-seconds") {
+            options.minSeconds = atof(value);
+        } else if (arg == "--max-bytes") {
+            options.maxBytes = (size_t)atof(value);
+        } else if (arg == "--algorithms") {
+            options.algorithms = value;
+        } else if (arg == "--distributions") {
+            options.distributions = value;
+        } else if (arg == "--records") {
+            options.records = value;
+        } else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            usage();
+            return 1;
+        }
+        ++i;
+    }
+
+    options.minN = std::max((size_t)1, options.minN);
+    options.reps = std::max(1, options.reps);
+
+    checkPriorityQueue();
+
+    printf("algorithm,distribution,record,record_bytes,n,reps,"
+           "ns_per_element_min,ns_per_element_median,ns_per_element_mean,ns_per_element_stddev,"
+           "cycles_per_element_median,allocations_per_sort,"
+           "comparisons_per_element,moves_per_element,swaps_per_element,max_depth\n");
+
+    benchmark<SmallRecord>("float+4", options);
+    benchmark<LargeRecord>("float+60", options);
+    benchmark<WideKeyRecord>("double+8", options);
+
+    return 0;
+}